@@ -0,0 +1,178 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zso.h"
+
+// Monte Carlo accumulation over many runs. Every metric keeps an online
+// mean and variance (Welford), so batches of any size need O(1) memory per
+// metric and the confidence intervals can be checked after every run.
+
+// Fold one observation into a running statistic
+void running_stat_add(RunningStat* stat, double value) {
+    if (stat->count == 0 || value < stat->min) {
+        stat->min = value;
+    }
+    if (stat->count == 0 || value > stat->max) {
+        stat->max = value;
+    }
+
+    stat->count++;
+    double delta = value - stat->mean;
+    stat->mean += delta / stat->count;
+    stat->m2 += delta * (value - stat->mean);
+}
+
+// Sample standard deviation, 0 for fewer than two observations
+double running_stat_stddev(const RunningStat* stat) {
+    if (stat->count < 2) {
+        return 0.0;
+    }
+    return sqrt(stat->m2 / (stat->count - 1));
+}
+
+// Two-sided standard normal quantile for the given confidence level (Acklam's approximation)
+static double normal_quantile(double confidence) {
+    static const double a[] = { -3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+                                1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00 };
+    static const double b[] = { -5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+                                6.680131188771972e+01, -1.328068155288572e+01 };
+    static const double c[] = { -7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                                -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00 };
+    static const double d[] = { 7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+                                3.754408661907416e+00 };
+
+    double p = 1.0 - (1.0 - confidence) / 2.0;
+    if (p > 0.97575) {
+        double q = sqrt(-2.0 * log(1.0 - p));
+        return -(((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+               ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1.0);
+    }
+
+    double q = p - 0.5;
+    double r = q * q;
+    return (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q /
+           (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1.0);
+}
+
+// Student t quantile. Below 30 degrees of freedom this uses Hill's algorithm
+// (CACM 396), exact for one and two degrees and within 0.05% otherwise; from
+// 30 on the Cornish-Fisher expansion of the normal quantile is within 0.1%.
+static double t_quantile(double confidence, long long degrees) {
+    const double half_pi = 1.5707963267948966;
+    double z = normal_quantile(confidence);
+    double n = (double)degrees;
+
+    if (degrees >= 30) {
+        double z3 = z * z * z;
+        double z5 = z3 * z * z;
+        return z + (z3 + z) / (4 * n) + (5 * z5 + 16 * z3 + 3 * z) / (96 * n * n);
+    }
+
+    double p = 1.0 - confidence;  // Two-sided tail probability
+    if (degrees == 1) {
+        return 1.0 / tan(p * half_pi);
+    }
+    if (degrees == 2) {
+        return sqrt(2.0 / (p * (2.0 - p)) - 2.0);
+    }
+
+    double a = 1.0 / (n - 0.5);
+    double b = 48.0 / (a * a);
+    double c = ((20700.0 * a / b - 98.0) * a - 16.0) * a + 96.36;
+    double d = ((94.5 / (b + c) - 3.0) / b + 1.0) * sqrt(a * half_pi) * n;
+    double y = pow(d * p, 2.0 / n);
+    if (y > 0.05 + a) {
+        double x = z;
+        y = x * x;
+        if (degrees < 5) {
+            c += 0.3 * (n - 4.5) * (x + 0.6);
+        }
+        c = (((0.05 * d * x - 5.0) * x - 7.0) * x - 2.0) * x + b + c;
+        y = (((((0.4 * y + 6.3) * y + 36.0) * y + 94.5) / c - y - 3.0) / b + 1.0) * x;
+        y = expm1(a * y * y);
+    } else {
+        y = ((1.0 / (((n + 6.0) / (n * y) - 0.089 * d - 0.822) * (n + 2.0) * 3.0) + 0.5 / (n + 4.0)) * y - 1.0) *
+                (n + 1.0) / (n + 2.0) +
+            1.0 / y;
+    }
+    return sqrt(n * y);
+}
+
+// Half-width of the confidence interval around the mean, 0 for fewer than two observations
+double running_stat_half_width(const RunningStat* stat, double confidence) {
+    if (stat->count < 2) {
+        return 0.0;
+    }
+    return t_quantile(confidence, stat->count - 1) * running_stat_stddev(stat) / sqrt((double)stat->count);
+}
+
+void batch_init(Batch* batch, const SimConfig* config) {
+    memset(batch, 0, sizeof(*batch));
+    batch->required_lessons = config->required_lessons;
+    batch->num_classes = config->num_classes;
+    batch->attendance = checked_calloc((size_t)config->required_lessons + 1, sizeof(RunningStat),
+                                       "batch attendance distribution");
+    batch->utilization = checked_calloc((size_t)config->num_classes, sizeof(RunningStat),
+                                        "batch classroom utilization");
+}
+
+void batch_free(Batch* batch) {
+    free(batch->attendance);
+    free(batch->utilization);
+}
+
+// Add one finished run to the batch
+void batch_add_run(Batch* batch, const Simulation* sim) {
+    const RunResult* result = &sim->result;
+
+    running_stat_add(&batch->student_completion,
+                     100.0 * result->students_completed / sim->config.total_students);
+    running_stat_add(&batch->teacher_completion,
+                     100.0 * result->teachers_completed / sim->config.num_teachers);
+    for (int i = 0; i <= batch->required_lessons; i++) {
+        running_stat_add(&batch->attendance[i], result->attendance_count[i]);
+    }
+    for (int i = 0; i < batch->num_classes; i++) {
+        running_stat_add(&batch->utilization[i], result->classroom_attendance[i]);
+    }
+}
+
+// True once both completion-rate intervals are at most target_half_width
+// percentage points wide on either side. Never true before BATCH_MIN_RUNS
+// runs, so a lucky streak of identical early runs cannot end the batch.
+bool batch_converged(const Batch* batch, double confidence, double target_half_width) {
+    if (target_half_width <= 0 || batch->student_completion.count < BATCH_MIN_RUNS) {
+        return false;
+    }
+    return running_stat_half_width(&batch->student_completion, confidence) <= target_half_width &&
+           running_stat_half_width(&batch->teacher_completion, confidence) <= target_half_width;
+}
+
+// Print mean, confidence interval and spread of every metric
+void batch_print(const Batch* batch, double confidence, FILE* out) {
+    const RunningStat* students = &batch->student_completion;
+    const RunningStat* teachers = &batch->teacher_completion;
+
+    fprintf(out, "\n===== Batch summary over %lld runs (%.0f%% confidence) =====\n",
+            students->count, confidence * 100);
+    fprintf(out, "Students who completed all lessons: %.1f%% +/- %.1f (sd %.1f, min %.1f, max %.1f)\n",
+            students->mean, running_stat_half_width(students, confidence),
+            running_stat_stddev(students), students->min, students->max);
+    fprintf(out, "Teachers who completed all lessons: %.1f%% +/- %.1f (sd %.1f, min %.1f, max %.1f)\n",
+            teachers->mean, running_stat_half_width(teachers, confidence),
+            running_stat_stddev(teachers), teachers->min, teachers->max);
+
+    fprintf(out, "\nMean lesson attendance distribution:\n");
+    for (int i = 0; i <= batch->required_lessons; i++) {
+        fprintf(out, "  Students who attended %d lessons: %.1f +/- %.1f\n", i,
+                batch->attendance[i].mean, running_stat_half_width(&batch->attendance[i], confidence));
+    }
+
+    fprintf(out, "\nMean classroom utilization:\n");
+    for (int i = 0; i < batch->num_classes; i++) {
+        fprintf(out, "  Classroom %d: %.1f +/- %.1f students attended\n", i,
+                batch->utilization[i].mean, running_stat_half_width(&batch->utilization[i], confidence));
+    }
+}
@@ -0,0 +1,334 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "zso.h"
+
+// zso_bench: runs project_zso over a list of school sizes and records the
+// cost of every run (wall and CPU time, context switches, throughput) as
+// CSV or JSON, one record per run. Simulation options are the same as for
+// the main program; warm-up runs are executed but not reported.
+//
+// Cache references and misses come from hardware counters opened once for
+// the whole process with inheritance, so agent and worker threads created
+// later are counted as well. Where perf_event_open is unavailable (no PMU,
+// perf_event_paranoid) the cache columns are -1.
+
+#define BENCH_MAX_SIZES 32
+#define BENCH_DEFAULT_REPETITIONS 5
+
+#define FORMAT_CSV 0
+#define FORMAT_JSON 1
+
+typedef struct {
+    int num_classes;
+    int students_per_class;
+} BenchSize;
+
+typedef struct {
+    BenchSize sizes[BENCH_MAX_SIZES];
+    int size_count;
+    int repetitions;
+    int warmup;
+    int format;
+    const char* output_path;  // NULL for stdout
+} BenchOptions;
+
+static BenchOptions bench = {
+    .size_count = 0,
+    .repetitions = BENCH_DEFAULT_REPETITIONS,
+    .warmup = 0,
+    .format = FORMAT_CSV,
+    .output_path = NULL,
+};
+
+static const char* engine_names[] = { "threads", "des", "deterministic", "coroutines" };
+
+// Hardware cache events, as perf_event_attr type and config
+#define CACHE_EVENT_COUNT 3
+
+static const struct {
+    unsigned int type;
+    unsigned long long config;
+} cache_events[CACHE_EVENT_COUNT] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+};
+
+static int cache_event_fds[CACHE_EVENT_COUNT] = { -1, -1, -1 };
+
+// Cost of one run
+typedef struct {
+    double wall_sec;
+    double user_sec;
+    double system_sec;
+    long voluntary_switches;
+    long involuntary_switches;
+    long long cache[CACHE_EVENT_COUNT];  // References, misses, L1D read misses; -1 if unavailable
+} RunCost;
+
+static void print_bench_usage(const char* program) {
+    printf("Usage: %s [options]\n"
+           "  --sizes=CxS[,CxS...]       school sizes as classes x students per class\n"
+           "                             (default: --classes x --students-per-class)\n"
+           "  --repetitions=N            measured runs per size (default %d)\n"
+           "  --warmup=N                 unreported runs per size before measuring (default 0)\n"
+           "  --format=csv|json          output format (default csv)\n"
+           "  --output=FILE              write results to FILE instead of stdout\n"
+           "Every option of the simulation itself (see ZSO_1 --help) is accepted too.\n",
+           program, BENCH_DEFAULT_REPETITIONS);
+}
+
+// Parse "5x20,50x20" into bench.sizes
+static bool parse_sizes(const char* value) {
+    bench.size_count = 0;
+
+    while (*value != '\0') {
+        if (bench.size_count == BENCH_MAX_SIZES) {
+            fprintf(stderr, "At most %d sizes are supported\n", BENCH_MAX_SIZES);
+            return false;
+        }
+
+        char* end;
+        long classes = strtol(value, &end, 10);
+        if (end == value || *end != 'x' || classes <= 0 || classes > 1000000000L) {
+            return false;
+        }
+        value = end + 1;
+
+        long students = strtol(value, &end, 10);
+        if (end == value || (*end != ',' && *end != '\0') || students <= 0 || students > 1000000000L) {
+            return false;
+        }
+        value = *end == ',' ? end + 1 : end;
+
+        bench.sizes[bench.size_count].num_classes = (int)classes;
+        bench.sizes[bench.size_count].students_per_class = (int)students;
+        bench.size_count++;
+    }
+    return bench.size_count > 0;
+}
+
+static bool bench_option(const char* name, const char* value, bool* ok) {
+    if (strcmp(name, "sizes") == 0) {
+        *ok = parse_sizes(value);
+    } else if (strcmp(name, "repetitions") == 0) {
+        *ok = parse_positive_int(value, &bench.repetitions);
+    } else if (strcmp(name, "warmup") == 0) {
+        if (strcmp(value, "0") == 0) {
+            bench.warmup = 0;
+            *ok = true;
+        } else {
+            *ok = parse_positive_int(value, &bench.warmup);
+        }
+    } else if (strcmp(name, "format") == 0) {
+        *ok = true;
+        if (strcmp(value, "csv") == 0) {
+            bench.format = FORMAT_CSV;
+        } else if (strcmp(value, "json") == 0) {
+            bench.format = FORMAT_JSON;
+        } else {
+            *ok = false;
+        }
+    } else if (strcmp(name, "output") == 0) {
+        free((void*)bench.output_path);
+        bench.output_path = copy_path(value);
+        *ok = true;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / NSEC_PER_SEC;
+}
+
+static double timeval_seconds(struct timeval tv) {
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+// Open the cache counters for this process and every thread it creates later
+static void open_cache_counters(void) {
+    for (int i = 0; i < CACHE_EVENT_COUNT; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = cache_events[i].type;
+        attr.config = cache_events[i].config;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        cache_event_fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    if (cache_event_fds[1] < 0) {
+        fprintf(stderr, "Hardware cache counters unavailable (%s), cache columns will be -1\n", strerror(errno));
+    }
+}
+
+static void close_cache_counters(void) {
+    for (int i = 0; i < CACHE_EVENT_COUNT; i++) {
+        if (cache_event_fds[i] >= 0) {
+            close(cache_event_fds[i]);
+        }
+    }
+}
+
+// Current value of every cache counter, -1 for those that could not be opened
+static void read_cache_counters(long long values[CACHE_EVENT_COUNT]) {
+    for (int i = 0; i < CACHE_EVENT_COUNT; i++) {
+        unsigned long long value;
+        if (cache_event_fds[i] >= 0 && read(cache_event_fds[i], &value, sizeof(value)) == sizeof(value)) {
+            values[i] = (long long)value;
+        } else {
+            values[i] = -1;
+        }
+    }
+}
+
+// Run the simulation once and measure it; RUSAGE_SELF includes exited threads
+static RunCost measure_run(Simulation* sim) {
+    struct rusage before;
+    struct rusage after;
+    long long cache_before[CACHE_EVENT_COUNT];
+    long long cache_after[CACHE_EVENT_COUNT];
+
+    getrusage(RUSAGE_SELF, &before);
+    read_cache_counters(cache_before);
+    double start = monotonic_seconds();
+
+    project_zso(sim);
+
+    double end = monotonic_seconds();
+    read_cache_counters(cache_after);
+    getrusage(RUSAGE_SELF, &after);
+
+    RunCost cost = {
+        .wall_sec = end - start,
+        .user_sec = timeval_seconds(after.ru_utime) - timeval_seconds(before.ru_utime),
+        .system_sec = timeval_seconds(after.ru_stime) - timeval_seconds(before.ru_stime),
+        .voluntary_switches = after.ru_nvcsw - before.ru_nvcsw,
+        .involuntary_switches = after.ru_nivcsw - before.ru_nivcsw,
+    };
+    for (int i = 0; i < CACHE_EVENT_COUNT; i++) {
+        bool valid = cache_before[i] >= 0 && cache_after[i] >= 0;
+        cost.cache[i] = valid ? cache_after[i] - cache_before[i] : -1;
+    }
+    return cost;
+}
+
+static void print_header(FILE* out) {
+    if (bench.format == FORMAT_CSV) {
+        fprintf(out, "engine,classes,students_per_class,students,repetition,wall_sec,cpu_user_sec,"
+                     "cpu_system_sec,thread_cpu_sec,thread_cpu_max_sec,voluntary_switches,"
+                     "involuntary_switches,cache_references,cache_misses,l1d_read_misses,lessons,lessons_per_sec,"
+                     "students_completed,lesson_start_avg_ms,lesson_start_max_ms\n");
+    } else {
+        fprintf(out, "[\n");
+    }
+}
+
+static void print_record(FILE* out, const Simulation* sim, int repetition, const RunCost* cost, bool first) {
+    const RunResult* result = &sim->result;
+    double lessons_per_sec = cost->wall_sec > 0 ? result->lessons_taught / cost->wall_sec : 0;
+    double lesson_start_avg_ms = result->lessons_taught > 0 ? result->lesson_start_sec / result->lessons_taught * 1e3 : 0;
+
+    if (bench.format == FORMAT_CSV) {
+        fprintf(out, "%s,%d,%d,%d,%d,%.6f,%.6f,%.6f,%.6f,%.6f,%ld,%ld,%lld,%lld,%lld,%d,%.1f,%d,%.3f,%.3f\n",
+                engine_names[sim->config.engine], sim->config.num_classes, sim->config.students_per_class,
+                sim->config.total_students, repetition, cost->wall_sec, cost->user_sec, cost->system_sec,
+                result->thread_cpu_sec, result->thread_cpu_max_sec, cost->voluntary_switches,
+                cost->involuntary_switches, cost->cache[0], cost->cache[1], cost->cache[2],
+                result->lessons_taught, lessons_per_sec, result->students_completed, lesson_start_avg_ms,
+                result->lesson_start_max_sec * 1e3);
+        return;
+    }
+
+    fprintf(out, "%s  {\"engine\": \"%s\", \"classes\": %d, \"students_per_class\": %d, \"students\": %d, "
+                 "\"repetition\": %d, \"wall_sec\": %.6f, \"cpu_user_sec\": %.6f, \"cpu_system_sec\": %.6f, "
+                 "\"thread_cpu_sec\": %.6f, \"thread_cpu_max_sec\": %.6f, \"voluntary_switches\": %ld, "
+                 "\"involuntary_switches\": %ld, \"cache_references\": %lld, \"cache_misses\": %lld, "
+                 "\"l1d_read_misses\": %lld, \"lessons\": %d, \"lessons_per_sec\": %.1f, "
+                 "\"students_completed\": %d, \"lesson_start_avg_ms\": %.3f, \"lesson_start_max_ms\": %.3f}",
+            first ? "" : ",\n", engine_names[sim->config.engine], sim->config.num_classes,
+            sim->config.students_per_class, sim->config.total_students, repetition, cost->wall_sec,
+            cost->user_sec, cost->system_sec, result->thread_cpu_sec, result->thread_cpu_max_sec,
+            cost->voluntary_switches, cost->involuntary_switches, cost->cache[0], cost->cache[1],
+            cost->cache[2], result->lessons_taught, lessons_per_sec, result->students_completed,
+            lesson_start_avg_ms, result->lesson_start_max_sec * 1e3);
+}
+
+static void print_footer(FILE* out) {
+    if (bench.format == FORMAT_JSON) {
+        fprintf(out, "\n]\n");
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (!parse_command_line(argc, argv, print_bench_usage, bench_option)) {
+        print_bench_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (bench.size_count == 0) {
+        bench.sizes[0].num_classes = config.num_classes;
+        bench.sizes[0].students_per_class = config.students_per_class;
+        bench.size_count = 1;
+    }
+
+    FILE* out = stdout;
+    if (bench.output_path != NULL) {
+        out = fopen(bench.output_path, "w");
+        if (out == NULL) {
+            fprintf(stderr, "Cannot open output file '%s': %s\n", bench.output_path, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    log_init();
+    open_cache_counters();
+    print_header(out);
+
+    bool first = true;
+    for (int s = 0; s < bench.size_count; s++) {
+        SimConfig size_config = config;
+        size_config.num_classes = bench.sizes[s].num_classes;
+        size_config.students_per_class = bench.sizes[s].students_per_class;
+        if (!derive_config_sizes(&size_config)) {
+            return EXIT_FAILURE;
+        }
+
+        Simulation* sim = simulation_create(&size_config);
+        for (int run = 0; run < bench.warmup + bench.repetitions; run++) {
+            sim->run_id = run;
+            RunCost cost = measure_run(sim);
+            if (run >= bench.warmup) {
+                print_record(out, sim, run - bench.warmup, &cost, first);
+                first = false;
+                fflush(out);
+            }
+        }
+        simulation_destroy(sim);
+    }
+
+    print_footer(out);
+    coro_pool_shutdown();
+    close_cache_counters();
+    log_shutdown();
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
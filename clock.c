@@ -0,0 +1,282 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zso.h"
+
+// Simulated time for the thread engines (--time-scale, --lesson-duration).
+//
+// Agents read time, wait and sleep in simulated seconds. With a positive
+// time scale the simulated clock is the wall clock since the run started
+// divided by the scale, so a timed wait or lesson lasts its simulated
+// length times the scale in real time. With scale 0 time is fully virtual
+// and only moves when nothing else can: the coroutine pool jumps its clock
+// once every worker is idle (see coro.c), and the thread-per-agent engine
+// uses the clock below. The deterministic scheduler always runs on its own
+// virtual clock.
+//
+// The virtual clock parks every timed wait in per-agent timers and counts
+// the agents that are still running. When the last one parks or exits,
+// the clock jumps to the earliest deadline and wakes that agent, so events
+// keep their order no matter how fast the host runs them. Signals go
+// through the clock as well: it must know a woken agent is running again
+// before that agent is scheduled by the OS.
+
+// A parked agent; lives on the waiting thread's stack
+typedef struct ClockWaiter {
+    pthread_cond_t wakeup;
+    pthread_cond_t* cond;
+    uint64_t deadline_ns;
+    unsigned long long seq;      // Equal deadlines and signals go oldest first
+    size_t timer_index;          // Position in the timer heap
+    bool waiting;
+    bool timed_out;
+    struct ClockWaiter* next;    // Wait list of the condition variable's bucket
+    struct ClockWaiter* prev;
+} ClockWaiter;
+
+typedef struct {
+    ClockWaiter* head;
+    ClockWaiter* tail;
+} ClockBucket;
+
+struct VirtualClock {
+    pthread_mutex_t mutex;
+    uint64_t now_ns;
+    int running;                 // Agents neither parked nor exited
+    unsigned long long next_seq;
+    ClockWaiter** timers;        // Min-heap by (deadline, seq), one entry per parked agent
+    size_t timer_count;
+    ClockBucket* buckets;        // Parked agents by condition variable address
+    size_t bucket_mask;
+};
+
+// Agent durations are given in seconds of simulated time
+static uint64_t seconds_to_ns(double seconds) {
+    return (uint64_t)(seconds * NSEC_PER_SEC);
+}
+
+static ClockBucket* bucket_for(VirtualClock* clock, const pthread_cond_t* cond) {
+    uintptr_t key = (uintptr_t)cond;
+    key ^= key >> 17;
+    key *= 0x9E3779B97F4A7C15ULL;
+    return &clock->buckets[(key >> 32) & clock->bucket_mask];
+}
+
+static bool timer_before(const ClockWaiter* a, const ClockWaiter* b) {
+    if (a->deadline_ns != b->deadline_ns) {
+        return a->deadline_ns < b->deadline_ns;
+    }
+    return a->seq < b->seq;
+}
+
+static void timer_place(VirtualClock* clock, size_t i, ClockWaiter* waiter) {
+    clock->timers[i] = waiter;
+    waiter->timer_index = i;
+}
+
+static void timer_sift_up(VirtualClock* clock, size_t i) {
+    ClockWaiter* waiter = clock->timers[i];
+    while (i > 0 && timer_before(waiter, clock->timers[(i - 1) / 2])) {
+        timer_place(clock, i, clock->timers[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    timer_place(clock, i, waiter);
+}
+
+static void timer_sift_down(VirtualClock* clock, size_t i) {
+    ClockWaiter* waiter = clock->timers[i];
+    for (;;) {
+        size_t smallest = 2 * i + 1;
+        if (smallest >= clock->timer_count) {
+            break;
+        }
+        if (smallest + 1 < clock->timer_count && timer_before(clock->timers[smallest + 1], clock->timers[smallest])) {
+            smallest++;
+        }
+        if (!timer_before(clock->timers[smallest], waiter)) {
+            break;
+        }
+        timer_place(clock, i, clock->timers[smallest]);
+        i = smallest;
+    }
+    timer_place(clock, i, waiter);
+}
+
+static void timer_remove(VirtualClock* clock, ClockWaiter* waiter) {
+    size_t i = waiter->timer_index;
+    ClockWaiter* last = clock->timers[--clock->timer_count];
+    if (last == waiter) {
+        return;
+    }
+    timer_place(clock, i, last);
+    timer_sift_down(clock, i);
+    timer_sift_up(clock, last->timer_index);
+}
+
+// Take a parked agent off its lists and let it run. Caller holds clock->mutex.
+static void wake_waiter(VirtualClock* clock, ClockWaiter* waiter, bool timed_out) {
+    ClockBucket* bucket = bucket_for(clock, waiter->cond);
+    if (waiter->prev != NULL) {
+        waiter->prev->next = waiter->next;
+    } else {
+        bucket->head = waiter->next;
+    }
+    if (waiter->next != NULL) {
+        waiter->next->prev = waiter->prev;
+    } else {
+        bucket->tail = waiter->prev;
+    }
+    timer_remove(clock, waiter);
+
+    waiter->waiting = false;
+    waiter->timed_out = timed_out;
+    clock->running++;
+    CHECK_PTHREAD_RETURN(pthread_cond_signal(&waiter->wakeup), "Virtual clock: waking agent");
+}
+
+// Nobody can run: jump to the earliest deadline. Caller holds clock->mutex.
+static void advance_if_idle(VirtualClock* clock) {
+    if (clock->running == 0 && clock->timer_count > 0) {
+        ClockWaiter* earliest = clock->timers[0];
+        clock->now_ns = earliest->deadline_ns;
+        wake_waiter(clock, earliest, true);
+    }
+}
+
+// Start timing a run. Call before any agent starts; agent_count agents
+// are running until they park or exit.
+void clock_start(Simulation* sim, int agent_count) {
+    if (sim->config.engine == ENGINE_COROUTINES) {
+        sim->clock_start_ns = coro_now_ns();
+    } else {
+        sim->clock_start_ns = monotonic_ns();
+    }
+    if (sim->config.engine != ENGINE_THREADS || sim->config.time_scale > 0) {
+        return;
+    }
+
+    VirtualClock* clock = checked_calloc(1, sizeof(VirtualClock), "virtual clock");
+    CHECK_PTHREAD_RETURN(pthread_mutex_init(&clock->mutex, NULL), "Virtual clock mutex initialization");
+    clock->running = agent_count;
+    clock->timers = checked_calloc((size_t)agent_count, sizeof(ClockWaiter*), "virtual clock timers");
+
+    size_t bucket_count = 64;
+    while (bucket_count < (size_t)agent_count) {
+        bucket_count *= 2;
+    }
+    clock->buckets = checked_calloc(bucket_count, sizeof(ClockBucket), "virtual clock buckets");
+    clock->bucket_mask = bucket_count - 1;
+
+    sim->virtual_clock = clock;
+}
+
+// Stop timing a run: records the simulated time it took
+void clock_stop(Simulation* sim) {
+    sim->result.simulated_sec = (double)sim_now_ns(sim) / NSEC_PER_SEC;
+
+    VirtualClock* clock = sim->virtual_clock;
+    if (clock == NULL) {
+        return;
+    }
+    CHECK_PTHREAD_RETURN(pthread_mutex_destroy(&clock->mutex), "Virtual clock mutex destruction");
+    free(clock->timers);
+    free(clock->buckets);
+    free(clock);
+    sim->virtual_clock = NULL;
+}
+
+// Simulated nanoseconds since clock_start
+uint64_t sim_now_ns(Simulation* sim) {
+    if (sim->scheduler != NULL) {
+        return seconds_to_ns(sched_now(sim));
+    }
+
+    VirtualClock* clock = sim->virtual_clock;
+    if (clock != NULL) {
+        CHECK_PTHREAD_RETURN(pthread_mutex_lock(&clock->mutex), "Virtual clock: lock for time");
+        uint64_t now = clock->now_ns;
+        CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&clock->mutex), "Virtual clock: unlock for time");
+        return now;
+    }
+
+    uint64_t start = sim->clock_start_ns;
+    if (sim->config.engine == ENGINE_COROUTINES) {
+        uint64_t elapsed = coro_now_ns() - start;
+        // The pool's virtual clock already counts simulated time
+        return sim->config.time_scale > 0 ? (uint64_t)((double)elapsed / sim->config.time_scale) : elapsed;
+    }
+    return (uint64_t)((double)(monotonic_ns() - start) / sim->config.time_scale);
+}
+
+// Virtual-time counterpart of a timed condition wait: releases mutex, parks
+// until signalled or the simulated deadline passes, then re-acquires mutex.
+// Returns 0 or ETIMEDOUT.
+int clock_wait(Simulation* sim, pthread_cond_t* cond, pthread_mutex_t* mutex, double timeout_sec) {
+    VirtualClock* clock = sim->virtual_clock;
+    ClockWaiter self = { .cond = cond, .waiting = true };
+    CHECK_PTHREAD_RETURN(pthread_cond_init(&self.wakeup, NULL), "Virtual clock: agent timer initialization");
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&clock->mutex), "Virtual clock: lock on wait");
+
+    self.deadline_ns = clock->now_ns + seconds_to_ns(timeout_sec);
+    self.seq = clock->next_seq++;
+    ClockBucket* bucket = bucket_for(clock, cond);
+    self.prev = bucket->tail;
+    if (bucket->tail != NULL) {
+        bucket->tail->next = &self;
+    } else {
+        bucket->head = &self;
+    }
+    bucket->tail = &self;
+    clock->timer_count++;
+    timer_place(clock, clock->timer_count - 1, &self);
+    timer_sift_up(clock, clock->timer_count - 1);
+
+    clock->running--;
+    advance_if_idle(clock);
+
+    // Signallers hold mutex, so nothing can slip in before we are listed
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(mutex), "Virtual clock: releasing caller mutex");
+    while (self.waiting) {
+        CHECK_PTHREAD_RETURN(pthread_cond_wait(&self.wakeup, &clock->mutex), "Virtual clock: parking agent");
+    }
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&clock->mutex), "Virtual clock: unlock on wait");
+    CHECK_PTHREAD_RETURN(pthread_cond_destroy(&self.wakeup), "Virtual clock: agent timer destruction");
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(mutex), "Virtual clock: re-acquiring caller mutex");
+    return self.timed_out ? ETIMEDOUT : 0;
+}
+
+// Wake the longest waiting agent parked on cond, or all of them
+void clock_signal(Simulation* sim, pthread_cond_t* cond, bool broadcast) {
+    VirtualClock* clock = sim->virtual_clock;
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&clock->mutex), "Virtual clock: lock on signal");
+    ClockWaiter* waiter = bucket_for(clock, cond)->head;
+    while (waiter != NULL) {
+        ClockWaiter* next = waiter->next;
+        if (waiter->cond == cond) {
+            wake_waiter(clock, waiter, false);
+            if (!broadcast) {
+                break;
+            }
+        }
+        waiter = next;
+    }
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&clock->mutex), "Virtual clock: unlock on signal");
+}
+
+// Called last thing on an agent thread
+void clock_agent_exit(Simulation* sim) {
+    VirtualClock* clock = sim->virtual_clock;
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&clock->mutex), "Virtual clock: lock on exit");
+    clock->running--;
+    advance_if_idle(clock);
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&clock->mutex), "Virtual clock: unlock on exit");
+}
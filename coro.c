@@ -0,0 +1,562 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "zso.h"
+
+// M:N engine: agents run as stackful coroutines (ucontext) on a fixed pool
+// of worker threads that is created on first use and kept until
+// coro_pool_shutdown, so many runs, even concurrent ones, share it.
+//
+// The agent bodies are the thread-per-agent ones. They block only in
+// wait_until, which here parks the coroutine on a wait list keyed by the
+// condition variable's address and lets the worker pick up another one.
+// signal_cond moves parked coroutines back to the ready queue. Timeouts
+// live in a min-heap that idle workers sleep on. Mutexes stay real pthread
+// mutexes: agents never yield while holding one, so a contended lock just
+// blocks a worker for the length of a short critical section.
+//
+// With --time-scale=0 the pool keeps its own virtual clock instead: timers
+// are set on it and, once every worker is idle with nothing ready, it jumps
+// to the earliest deadline. Runs still spawning their agents hold the clock
+// so it cannot move before all of them exist.
+//
+// A coroutine never makes itself waitable: it records what it wants and
+// switches back to its worker, which publishes the wait and only then
+// releases the caller's mutex. A signal can therefore never resume a
+// coroutine that is still running.
+
+#define CORO_STACK_SIZE (32 * 1024)
+#define CORO_WAIT_BUCKETS 4096
+
+// What a coroutine asks its worker to do after switching back
+#define CORO_ACTION_WAIT 0
+#define CORO_ACTION_DONE 1
+
+typedef struct Worker Worker;
+typedef struct Coroutine Coroutine;
+
+struct CoroRun {
+    pthread_mutex_t mutex;
+    pthread_cond_t done;
+    int live;  // Coroutines of this run that have not finished
+};
+
+struct Coroutine {
+    ucontext_t context;
+    void* stack;
+    Worker* worker;          // Worker currently running the coroutine
+    CoroRun* run;
+    void* (*function)(void*);
+    void* arg;
+    int action;
+
+    // Current wait, protected by the bucket lock of cond
+    pthread_cond_t* cond;
+    pthread_mutex_t* mutex;
+    uint64_t deadline_ns;
+    _Atomic unsigned int wait_serial;  // Identifies the wait a timer belongs to
+    bool waiting;
+    bool timed_out;
+    Coroutine* wait_next;
+    Coroutine* wait_prev;
+
+    Coroutine* ready_next;   // Ready queue or free list link
+};
+
+struct Worker {
+    pthread_t thread;
+    ucontext_t context;
+};
+
+typedef struct {
+    uint64_t deadline_ns;
+    Coroutine* coroutine;
+    pthread_cond_t* cond;
+    unsigned int serial;
+} CoroTimer;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    Coroutine* head;
+    Coroutine* tail;
+} WaitBucket;
+
+// The process-wide pool; mutex protects everything but the wait buckets
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t work;       // Ready coroutines or an earlier timer
+    bool started;
+    bool shutdown;
+    bool virtual_time;         // Timers run on virtual_ns instead of the monotonic clock
+    _Atomic uint64_t virtual_ns;
+    int holds;                 // Runs still spawning, the virtual clock waits for them
+    Worker* workers;
+    int worker_count;
+    int idle_workers;
+    Coroutine* ready_head;
+    Coroutine* ready_tail;
+    Coroutine* free_list;      // Finished coroutines, stacks kept for reuse
+    CoroTimer* timers;         // Min-heap by deadline
+    size_t timer_count;
+    size_t timer_capacity;
+    WaitBucket buckets[CORO_WAIT_BUCKETS];
+} pool = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+// Coroutine running on this worker thread. Only read through
+// current_coroutine, before the caller switches away: a resumed coroutine
+// may be on a different worker, so no TLS address may be cached across a switch.
+static _Thread_local Coroutine* running_coroutine;
+
+__attribute__((noinline)) static Coroutine* current_coroutine(void) {
+    return running_coroutine;
+}
+
+// Current time of the pool's timers
+uint64_t coro_now_ns(void) {
+    if (pool.virtual_time) {
+        return atomic_load_explicit(&pool.virtual_ns, memory_order_acquire);
+    }
+    return monotonic_ns();
+}
+
+static WaitBucket* bucket_for(const pthread_cond_t* cond) {
+    uintptr_t key = (uintptr_t)cond;
+    key ^= key >> 17;
+    key *= 0x9E3779B97F4A7C15ULL;
+    return &pool.buckets[(key >> 32) % CORO_WAIT_BUCKETS];
+}
+
+// Append to the ready queue. Caller holds pool.mutex.
+static void push_ready(Coroutine* coroutine) {
+    coroutine->ready_next = NULL;
+    if (pool.ready_tail != NULL) {
+        pool.ready_tail->ready_next = coroutine;
+    } else {
+        pool.ready_head = coroutine;
+    }
+    pool.ready_tail = coroutine;
+    CHECK_PTHREAD_RETURN(pthread_cond_signal(&pool.work), "Coroutine pool: signalling work");
+}
+
+static void push_ready_list(Coroutine* list) {
+    if (list == NULL) {
+        return;
+    }
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&pool.mutex), "Coroutine pool: lock for ready");
+    while (list != NULL) {
+        Coroutine* next = list->ready_next;
+        push_ready(list);
+        list = next;
+    }
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&pool.mutex), "Coroutine pool: unlock for ready");
+}
+
+static void timer_swap(size_t a, size_t b) {
+    CoroTimer tmp = pool.timers[a];
+    pool.timers[a] = pool.timers[b];
+    pool.timers[b] = tmp;
+}
+
+// Caller holds pool.mutex
+static void push_timer(CoroTimer timer) {
+    if (pool.timer_count == pool.timer_capacity) {
+        size_t capacity = pool.timer_capacity ? pool.timer_capacity * 2 : 1024;
+        CoroTimer* timers = realloc(pool.timers, capacity * sizeof(CoroTimer));
+        if (timers == NULL) {
+            fprintf(stderr, "Failed to allocate memory for coroutine timers\n");
+            exit(EXIT_FAILURE);
+        }
+        pool.timers = timers;
+        pool.timer_capacity = capacity;
+    }
+
+    size_t i = pool.timer_count++;
+    pool.timers[i] = timer;
+    while (i > 0 && pool.timers[(i - 1) / 2].deadline_ns > pool.timers[i].deadline_ns) {
+        timer_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+
+    // A new earliest deadline must shorten some idle worker's sleep
+    if (i == 0) {
+        CHECK_PTHREAD_RETURN(pthread_cond_signal(&pool.work), "Coroutine pool: signalling timer");
+    }
+}
+
+// Caller holds pool.mutex and pool.timer_count > 0
+static CoroTimer pop_timer(void) {
+    CoroTimer top = pool.timers[0];
+    pool.timers[0] = pool.timers[--pool.timer_count];
+
+    size_t i = 0;
+    for (;;) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < pool.timer_count && pool.timers[left].deadline_ns < pool.timers[smallest].deadline_ns) {
+            smallest = left;
+        }
+        if (right < pool.timer_count && pool.timers[right].deadline_ns < pool.timers[smallest].deadline_ns) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            break;
+        }
+        timer_swap(i, smallest);
+        i = smallest;
+    }
+    return top;
+}
+
+static void unlink_waiter(WaitBucket* bucket, Coroutine* coroutine) {
+    if (coroutine->wait_prev != NULL) {
+        coroutine->wait_prev->wait_next = coroutine->wait_next;
+    } else {
+        bucket->head = coroutine->wait_next;
+    }
+    if (coroutine->wait_next != NULL) {
+        coroutine->wait_next->wait_prev = coroutine->wait_prev;
+    } else {
+        bucket->tail = coroutine->wait_prev;
+    }
+    coroutine->waiting = false;
+}
+
+// Wake a coroutine whose timer expired, unless it was signalled since
+static void expire_timer(CoroTimer timer) {
+    Coroutine* coroutine = timer.coroutine;
+    if (atomic_load_explicit(&coroutine->wait_serial, memory_order_acquire) != timer.serial) {
+        return;
+    }
+
+    WaitBucket* bucket = bucket_for(timer.cond);
+    bool woken = false;
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&bucket->mutex), "Coroutine pool: bucket lock for timeout");
+    if (coroutine->waiting && coroutine->cond == timer.cond &&
+        atomic_load_explicit(&coroutine->wait_serial, memory_order_relaxed) == timer.serial) {
+        unlink_waiter(bucket, coroutine);
+        coroutine->timed_out = true;
+        woken = true;
+    }
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&bucket->mutex), "Coroutine pool: bucket unlock for timeout");
+
+    if (woken) {
+        coroutine->ready_next = NULL;
+        push_ready_list(coroutine);
+    }
+}
+
+// Publish the wait a coroutine switched out for, then release its mutex
+static void publish_wait(Coroutine* coroutine) {
+    WaitBucket* bucket = bucket_for(coroutine->cond);
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&bucket->mutex), "Coroutine pool: bucket lock for wait");
+    coroutine->waiting = true;
+    coroutine->timed_out = false;
+    coroutine->wait_next = NULL;
+    coroutine->wait_prev = bucket->tail;
+    if (bucket->tail != NULL) {
+        bucket->tail->wait_next = coroutine;
+    } else {
+        bucket->head = coroutine;
+    }
+    bucket->tail = coroutine;
+    // Once the bucket is unlocked the coroutine may be resumed elsewhere
+    CoroTimer timer = { coroutine->deadline_ns, coroutine, coroutine->cond,
+                        atomic_load_explicit(&coroutine->wait_serial, memory_order_relaxed) };
+    pthread_mutex_t* mutex = coroutine->mutex;
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&bucket->mutex), "Coroutine pool: bucket unlock for wait");
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(mutex), "Coroutine: releasing caller mutex");
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&pool.mutex), "Coroutine pool: lock for timer");
+    push_timer(timer);
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&pool.mutex), "Coroutine pool: unlock for timer");
+}
+
+static void finish_coroutine(Coroutine* coroutine) {
+    CoroRun* run = coroutine->run;
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&pool.mutex), "Coroutine pool: lock for recycling");
+    coroutine->ready_next = pool.free_list;
+    pool.free_list = coroutine;
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&pool.mutex), "Coroutine pool: unlock for recycling");
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&run->mutex), "Coroutine run: lock on finish");
+    if (--run->live == 0) {
+        CHECK_PTHREAD_RETURN(pthread_cond_signal(&run->done), "Coroutine run: signalling completion");
+    }
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&run->mutex), "Coroutine run: unlock on finish");
+}
+
+static void* worker_function(void* arg) {
+    Worker* worker = arg;
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&pool.mutex), "Coroutine worker: lock");
+    while (!pool.shutdown) {
+        if (pool.timer_count > 0 && pool.timers[0].deadline_ns <= coro_now_ns()) {
+            CoroTimer timer = pop_timer();
+            CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&pool.mutex), "Coroutine worker: unlock for timeout");
+            expire_timer(timer);
+            CHECK_PTHREAD_RETURN(pthread_mutex_lock(&pool.mutex), "Coroutine worker: lock after timeout");
+            continue;
+        }
+
+        Coroutine* coroutine = pool.ready_head;
+        if (coroutine != NULL) {
+            pool.ready_head = coroutine->ready_next;
+            if (pool.ready_head == NULL) {
+                pool.ready_tail = NULL;
+            }
+            CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&pool.mutex), "Coroutine worker: unlock for resume");
+
+            coroutine->worker = worker;
+            running_coroutine = coroutine;
+            if (swapcontext(&worker->context, &coroutine->context) != 0) {
+                perror("swapcontext");
+                exit(EXIT_FAILURE);
+            }
+            running_coroutine = NULL;
+
+            if (coroutine->action == CORO_ACTION_WAIT) {
+                publish_wait(coroutine);
+            } else {
+                finish_coroutine(coroutine);
+            }
+
+            CHECK_PTHREAD_RETURN(pthread_mutex_lock(&pool.mutex), "Coroutine worker: lock after resume");
+            continue;
+        }
+
+        if (pool.virtual_time) {
+            // Everyone else is idle and nothing is ready: jump to the next deadline
+            if (pool.timer_count > 0 && pool.holds == 0 && pool.idle_workers == pool.worker_count - 1) {
+                atomic_store_explicit(&pool.virtual_ns, pool.timers[0].deadline_ns, memory_order_release);
+                continue;
+            }
+            pool.idle_workers++;
+            CHECK_PTHREAD_RETURN(pthread_cond_wait(&pool.work, &pool.mutex), "Coroutine worker: wait for work");
+            pool.idle_workers--;
+        } else if (pool.timer_count > 0) {
+            uint64_t deadline = pool.timers[0].deadline_ns;
+            struct timespec ts = { (time_t)(deadline / NSEC_PER_SEC), (long)(deadline % NSEC_PER_SEC) };
+            int result = pthread_cond_timedwait(&pool.work, &pool.mutex, &ts);
+            if (result != 0 && result != ETIMEDOUT) {
+                CHECK_PTHREAD_RETURN(result, "Coroutine worker: timed wait for work");
+            }
+        } else {
+            CHECK_PTHREAD_RETURN(pthread_cond_wait(&pool.work, &pool.mutex), "Coroutine worker: wait for work");
+        }
+    }
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&pool.mutex), "Coroutine worker: unlock");
+    return NULL;
+}
+
+// Start the pool on first use. Caller holds pool.mutex.
+static void start_pool(int worker_count, bool virtual_time) {
+    if (worker_count <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        worker_count = cores > 0 ? (int)cores : 1;
+    }
+
+    init_monotonic_cond(&pool.work, "Coroutine pool condition initialization");
+    for (int i = 0; i < CORO_WAIT_BUCKETS; i++) {
+        CHECK_PTHREAD_RETURN(pthread_mutex_init(&pool.buckets[i].mutex, NULL),
+                            "Coroutine bucket mutex initialization");
+    }
+
+    pool.virtual_time = virtual_time;
+    pool.workers = checked_calloc((size_t)worker_count, sizeof(Worker), "coroutine workers");
+    pool.worker_count = worker_count;
+    for (int i = 0; i < worker_count; i++) {
+        CHECK_PTHREAD_RETURN(pthread_create(&pool.workers[i].thread, NULL, worker_function, &pool.workers[i]),
+                            "Coroutine worker creation");
+    }
+    pool.started = true;
+}
+
+// Join the workers and free every coroutine; the pool restarts on next use
+void coro_pool_shutdown(void) {
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&pool.mutex), "Coroutine pool: lock for shutdown");
+    if (!pool.started) {
+        CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&pool.mutex), "Coroutine pool: unlock for shutdown");
+        return;
+    }
+    pool.shutdown = true;
+    CHECK_PTHREAD_RETURN(pthread_cond_broadcast(&pool.work), "Coroutine pool: broadcasting shutdown");
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&pool.mutex), "Coroutine pool: unlock for shutdown");
+
+    for (int i = 0; i < pool.worker_count; i++) {
+        CHECK_PTHREAD_RETURN(pthread_join(pool.workers[i].thread, NULL), "Coroutine worker join");
+    }
+
+    while (pool.free_list != NULL) {
+        Coroutine* coroutine = pool.free_list;
+        pool.free_list = coroutine->ready_next;
+        free(coroutine->stack);
+        free(coroutine);
+    }
+    for (int i = 0; i < CORO_WAIT_BUCKETS; i++) {
+        CHECK_PTHREAD_RETURN(pthread_mutex_destroy(&pool.buckets[i].mutex), "Coroutine bucket mutex destruction");
+    }
+    CHECK_PTHREAD_RETURN(pthread_cond_destroy(&pool.work), "Coroutine pool condition destruction");
+
+    free(pool.workers);
+    free(pool.timers);
+    pool.workers = NULL;
+    pool.worker_count = 0;
+    pool.timers = NULL;
+    pool.timer_count = 0;
+    pool.timer_capacity = 0;
+    pool.idle_workers = 0;
+    pool.started = false;
+    pool.shutdown = false;
+}
+
+// makecontext only passes ints, so the coroutine pointer arrives in two halves
+static void coroutine_entry(unsigned int high, unsigned int low) {
+    Coroutine* coroutine = (Coroutine*)(((uintptr_t)high << 32) | (uintptr_t)low);
+
+    coroutine->function(coroutine->arg);
+
+    coroutine->action = CORO_ACTION_DONE;
+    setcontext(&coroutine->worker->context);
+}
+
+// Register a run; with virtual_time the pool's clock stands still until
+// coro_run_end. The clock mode is fixed by the run that starts the pool.
+CoroRun* coro_run_begin(int worker_count, bool virtual_time) {
+    CoroRun* run = checked_calloc(1, sizeof(CoroRun), "coroutine run");
+    CHECK_PTHREAD_RETURN(pthread_mutex_init(&run->mutex, NULL), "Coroutine run mutex initialization");
+    CHECK_PTHREAD_RETURN(pthread_cond_init(&run->done, NULL), "Coroutine run condition initialization");
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&pool.mutex), "Coroutine pool: lock for start");
+    if (!pool.started) {
+        start_pool(worker_count, virtual_time);
+    } else if (pool.virtual_time != virtual_time) {
+        fprintf(stderr, "Coroutine pool already runs on a different clock\n");
+        exit(EXIT_FAILURE);
+    }
+    pool.holds++;
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&pool.mutex), "Coroutine pool: unlock for start");
+    return run;
+}
+
+// Create a coroutine running function(arg) and queue it
+void coro_spawn(CoroRun* run, void* (*function)(void*), void* arg) {
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&pool.mutex), "Coroutine pool: lock for spawn");
+    Coroutine* coroutine = pool.free_list;
+    if (coroutine != NULL) {
+        pool.free_list = coroutine->ready_next;
+    }
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&pool.mutex), "Coroutine pool: unlock for spawn");
+
+    if (coroutine == NULL) {
+        coroutine = checked_calloc(1, sizeof(Coroutine), "coroutine");
+        // Plain malloc: untouched stack pages never become resident
+        coroutine->stack = malloc(CORO_STACK_SIZE);
+        if (coroutine->stack == NULL) {
+            fprintf(stderr, "Failed to allocate memory for coroutine stack\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    coroutine->run = run;
+    coroutine->function = function;
+    coroutine->arg = arg;
+    coroutine->waiting = false;
+
+    if (getcontext(&coroutine->context) != 0) {
+        perror("getcontext");
+        exit(EXIT_FAILURE);
+    }
+    coroutine->context.uc_stack.ss_sp = coroutine->stack;
+    coroutine->context.uc_stack.ss_size = CORO_STACK_SIZE;
+    coroutine->context.uc_link = NULL;
+    uintptr_t address = (uintptr_t)coroutine;
+    makecontext(&coroutine->context, (void (*)(void))coroutine_entry, 2,
+                (unsigned int)(address >> 32), (unsigned int)(address & 0xFFFFFFFFu));
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&run->mutex), "Coroutine run: lock for spawn");
+    run->live++;
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&run->mutex), "Coroutine run: unlock for spawn");
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&pool.mutex), "Coroutine pool: lock for queueing");
+    push_ready(coroutine);
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&pool.mutex), "Coroutine pool: unlock for queueing");
+}
+
+// Block the calling (non-pool) thread until every coroutine of the run has finished
+void coro_run_end(CoroRun* run) {
+    // Every agent exists now; an idle pool may move its clock
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&pool.mutex), "Coroutine pool: lock for release");
+    pool.holds--;
+    CHECK_PTHREAD_RETURN(pthread_cond_signal(&pool.work), "Coroutine pool: signalling release");
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&pool.mutex), "Coroutine pool: unlock for release");
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&run->mutex), "Coroutine run: lock for join");
+    while (run->live > 0) {
+        CHECK_PTHREAD_RETURN(pthread_cond_wait(&run->done, &run->mutex), "Coroutine run: waiting for agents");
+    }
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&run->mutex), "Coroutine run: unlock for join");
+
+    CHECK_PTHREAD_RETURN(pthread_cond_destroy(&run->done), "Coroutine run condition destruction");
+    CHECK_PTHREAD_RETURN(pthread_mutex_destroy(&run->mutex), "Coroutine run mutex destruction");
+    free(run);
+}
+
+// Coroutine-side half of a wait: runs on the coroutine's stack
+int coro_wait(pthread_cond_t* cond, pthread_mutex_t* mutex, double timeout_sec) {
+    Coroutine* self = current_coroutine();
+
+    self->cond = cond;
+    self->mutex = mutex;
+    self->deadline_ns = coro_now_ns() + (uint64_t)(timeout_sec * NSEC_PER_SEC);
+    self->action = CORO_ACTION_WAIT;
+    atomic_fetch_add_explicit(&self->wait_serial, 1, memory_order_release);
+
+    // The worker publishes the wait and releases mutex; we may resume on another worker
+    if (swapcontext(&self->context, &self->worker->context) != 0) {
+        perror("swapcontext");
+        exit(EXIT_FAILURE);
+    }
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(mutex), "Coroutine: re-acquiring caller mutex");
+    return self->timed_out ? ETIMEDOUT : 0;
+}
+
+// Wake the longest waiting coroutine parked on cond, or all of them
+void coro_signal(pthread_cond_t* cond, bool broadcast) {
+    WaitBucket* bucket = bucket_for(cond);
+    Coroutine* woken = NULL;
+    Coroutine** woken_tail = &woken;
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&bucket->mutex), "Coroutine pool: bucket lock for signal");
+    Coroutine* coroutine = bucket->head;
+    while (coroutine != NULL) {
+        Coroutine* next = coroutine->wait_next;
+        if (coroutine->cond == cond) {
+            unlink_waiter(bucket, coroutine);
+            coroutine->timed_out = false;
+            coroutine->ready_next = NULL;
+            *woken_tail = coroutine;
+            woken_tail = &coroutine->ready_next;
+            if (!broadcast) {
+                break;
+            }
+        }
+        coroutine = next;
+    }
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&bucket->mutex), "Coroutine pool: bucket unlock for signal");
+
+    push_ready_list(woken);
+}
@@ -0,0 +1,132 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zso.h"
+
+// Event counters of the thread engines.
+//
+// Every agent counts into a cache line of its own, found through a
+// thread-local pointer that the agent binds when it starts, so code without
+// an agent id at hand (lock_mutex, signal_cond) can count too and nothing
+// is shared while the run is active. The lines are summed into the run
+// result once every agent has finished. Coroutine agents may resume on
+// another worker after a wait; wait_until restores the binding afterwards.
+
+struct AgentCounters {
+    _Alignas(CACHE_LINE_SIZE) unsigned long long counts[COUNTER_KINDS];
+    WakeCounters* waker;  // Signal site that ended the last wait, with --wake-stats
+};
+
+static const char* const counter_names[COUNTER_KINDS] = {
+    "Classroom probes",
+    "Failed joins",
+    "Useful wakeups",
+    "Spurious wakeups",
+    "Timeouts",
+    "Broadcasts sent",
+    "Lock acquisitions",
+};
+
+// Counters of the agent running on this thread. Like the running coroutine
+// in coro.c, only accessed through non-inlined functions so no TLS address
+// is cached across a coroutine switch.
+static _Thread_local AgentCounters* bound_counters;
+
+// Teachers, students and the matcher slot
+static size_t counter_slots(const Simulation* sim) {
+    return (size_t)sim->config.num_teachers + (size_t)sim->config.total_students + 1;
+}
+
+void counters_init(Simulation* sim) {
+    sim->agent_counters = checked_aligned_calloc(counter_slots(sim), sizeof(AgentCounters), "agent counters");
+}
+
+void counters_free(Simulation* sim) {
+    free(sim->agent_counters);
+}
+
+void counters_reset(Simulation* sim) {
+    memset(sim->agent_counters, 0, counter_slots(sim) * sizeof(AgentCounters));
+}
+
+// Count the events of this thread for an agent (teachers first, then
+// students, then the matcher), or for nobody with slot -1
+__attribute__((noinline)) void counters_bind(Simulation* sim, int slot) {
+    bound_counters = slot >= 0 ? &sim->agent_counters[slot] : NULL;
+}
+
+__attribute__((noinline)) AgentCounters* counters_current(void) {
+    return bound_counters;
+}
+
+__attribute__((noinline)) void counters_restore(AgentCounters* counters) {
+    bound_counters = counters;
+}
+
+// Remember which signal site ended the wait that just returned, if known
+void counters_set_waker(WakeCounters* site) {
+    AgentCounters* counters = counters_current();
+    if (counters != NULL) {
+        counters->waker = site;
+    }
+}
+
+void counter_add(int counter) {
+    AgentCounters* counters = counters_current();
+    if (counters != NULL) {
+        counters->counts[counter]++;
+    }
+}
+
+// Count a finished timed wait: expired, or signalled and (progress) finding
+// what it waited for or not. A signalled wait is charged to the site that
+// woke it as well.
+void counter_wait_result(int wait_result, bool progress) {
+    if (wait_result == ETIMEDOUT) {
+        counter_add(COUNTER_TIMEOUTS);
+        return;
+    }
+    counter_add(progress ? COUNTER_USEFUL_WAKEUPS : COUNTER_SPURIOUS_WAKEUPS);
+
+    AgentCounters* counters = counters_current();
+    if (counters != NULL && counters->waker != NULL) {
+        atomic_fetch_add_explicit(&counters->waker->woken, 1, memory_order_relaxed);
+        if (progress) {
+            atomic_fetch_add_explicit(&counters->waker->progress, 1, memory_order_relaxed);
+        }
+        counters->waker = NULL;
+    }
+}
+
+// Sum every agent's counters into the run result. Called after all agents
+// have been joined.
+void counters_collect(Simulation* sim) {
+    memset(sim->result.counters, 0, sizeof(sim->result.counters));
+    for (size_t slot = 0; slot < counter_slots(sim); slot++) {
+        for (int counter = 0; counter < COUNTER_KINDS; counter++) {
+            sim->result.counters[counter] += sim->agent_counters[slot].counts[counter];
+        }
+    }
+}
+
+void print_counter_report(const Simulation* sim, FILE* out) {
+    if (sim->agent_counters == NULL) {
+        return;
+    }
+
+    const unsigned long long* counts = sim->result.counters;
+    unsigned long long wakeups = counts[COUNTER_USEFUL_WAKEUPS] + counts[COUNTER_SPURIOUS_WAKEUPS];
+    int lessons = sim->result.lessons_taught;
+
+    fprintf(out, "\nAgent events:                      total  per lesson\n");
+    for (int counter = 0; counter < COUNTER_KINDS; counter++) {
+        fprintf(out, "  %-28s %12llu %11.1f\n", counter_names[counter], counts[counter],
+                lessons > 0 ? (double)counts[counter] / lessons : 0);
+    }
+    if (wakeups > 0) {
+        fprintf(out, "  %.1f%% of %llu wakeups found nothing to do\n",
+                100.0 * counts[COUNTER_SPURIOUS_WAKEUPS] / wakeups, wakeups);
+    }
+}
@@ -0,0 +1,492 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "zso.h"
+
+// Discrete-event implementation of the teacher/student protocol.
+//
+// A single thread pops events from a calendar ordered by (virtual time,
+// scheduling order). Only state changes are modelled as events: a student
+// that finds no open classroom parks in a FIFO and is pulled in when a
+// teacher opens a room, so the polling timeouts of the threaded engine are
+// only simulated where they change the outcome (the teacher's wait loop).
+
+// Event types
+#define EVENT_TEACHER_OPEN 0    // Teacher prepares the classroom for the next lesson
+#define EVENT_TEACHER_TIMEOUT 1 // Teacher's timed wait for students expired
+#define EVENT_LESSON_START 2    // Teacher woke up with enough students inside
+#define EVENT_LESSON_END 3      // Lesson finished after lesson_duration_sec
+#define EVENT_STUDENT_SEARCH 4  // Student looks for a classroom to join
+
+#define MAX_TEACHER_WAITS 3 // Same limit as max_waits in teacher_function
+#define NOT_WAITING (-2)    // wait_prev marker for students outside the FIFO
+
+typedef struct {
+    double time;
+    unsigned long long seq; // Tie-breaker: equal times run in scheduling order
+    int type;
+    int agent;              // Teacher or student id
+    unsigned int serial;    // Lesson serial for timeouts, stale ones are ignored
+} Event;
+
+// Binary min-heap of pending events
+typedef struct {
+    Event* events;
+    size_t count;
+    size_t capacity;
+    unsigned long long next_seq;
+} EventCalendar;
+
+// Engine-only classroom state, alongside the shared Classroom fields
+typedef struct {
+    int wait_count;     // Teacher timeouts during the current wait
+    unsigned int serial;
+    int lessons_taught;
+} DesClassroom;
+
+typedef struct {
+    Simulation* sim;
+    EventCalendar calendar;
+    DesClassroom* rooms;
+    uint64_t* open_rooms;  // Bitmap of classrooms accepting students
+    size_t open_words;
+    int* wait_next;        // FIFO of students with no classroom to join
+    int* wait_prev;
+    int wait_head;
+    int wait_tail;
+    double now;
+    unsigned long long events_processed;
+} DesState;
+
+static bool event_before(const Event* a, const Event* b) {
+    if (a->time != b->time) {
+        return a->time < b->time;
+    }
+    return a->seq < b->seq;
+}
+
+static void schedule_event(DesState* des, double time, int type, int agent, unsigned int serial) {
+    EventCalendar* cal = &des->calendar;
+
+    if (cal->count == cal->capacity) {
+        size_t capacity = cal->capacity ? cal->capacity * 2 : 1024;
+        Event* events = realloc(cal->events, capacity * sizeof(Event));
+        if (events == NULL) {
+            fprintf(stderr, "Failed to allocate memory for event calendar\n");
+            exit(EXIT_FAILURE);
+        }
+        cal->events = events;
+        cal->capacity = capacity;
+    }
+
+    Event ev = { time, cal->next_seq++, type, agent, serial };
+    size_t i = cal->count++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!event_before(&ev, &cal->events[parent])) {
+            break;
+        }
+        cal->events[i] = cal->events[parent];
+        i = parent;
+    }
+    cal->events[i] = ev;
+}
+
+static bool next_event(DesState* des, Event* out) {
+    EventCalendar* cal = &des->calendar;
+    if (cal->count == 0) {
+        return false;
+    }
+
+    *out = cal->events[0];
+    Event last = cal->events[--cal->count];
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= cal->count) {
+            break;
+        }
+        if (child + 1 < cal->count && event_before(&cal->events[child + 1], &cal->events[child])) {
+            child++;
+        }
+        if (!event_before(&cal->events[child], &last)) {
+            break;
+        }
+        cal->events[i] = cal->events[child];
+        i = child;
+    }
+    if (cal->count > 0) {
+        cal->events[i] = last;
+    }
+    return true;
+}
+
+static void set_room_open(DesState* des, int classroom_id, bool open) {
+    uint64_t bit = 1ULL << (classroom_id % 64);
+    if (open) {
+        des->open_rooms[classroom_id / 64] |= bit;
+    } else {
+        des->open_rooms[classroom_id / 64] &= ~bit;
+    }
+}
+
+// First open classroom with id >= from, or -1
+static int next_open_room(DesState* des, int from) {
+    Simulation* sim = des->sim;
+    if (from >= sim->config.num_classes) {
+        return -1;
+    }
+
+    size_t word = (size_t)from / 64;
+    uint64_t bits = des->open_rooms[word] & (~0ULL << (from % 64));
+    while (bits == 0) {
+        if (++word >= des->open_words) {
+            return -1;
+        }
+        bits = des->open_rooms[word];
+    }
+    return (int)(word * 64 + (size_t)__builtin_ctzll(bits));
+}
+
+// Event log timestamps are simulated nanoseconds
+static uint64_t des_now_ns(const DesState* des) {
+    return (uint64_t)(des->now * NSEC_PER_SEC);
+}
+
+static int student_agent(const DesState* des, int student_id) {
+    return des->sim->config.num_teachers + student_id;
+}
+
+// Same preference order as student_function: (student_id + offset) % num_classes
+static int find_classroom_for(DesState* des, int student_id) {
+    Simulation* sim = des->sim;
+    int start = student_id % sim->config.num_classes;
+    int lessons = sim->student_lessons_attended[student_id];
+
+    for (int room = next_open_room(des, start); room >= 0; room = next_open_room(des, room + 1)) {
+        if (!student_already_attended_classroom(sim, student_id, room, lessons)) {
+            return room;
+        }
+    }
+    for (int room = next_open_room(des, 0); room >= 0 && room < start; room = next_open_room(des, room + 1)) {
+        if (!student_already_attended_classroom(sim, student_id, room, lessons)) {
+            return room;
+        }
+    }
+    return -1;
+}
+
+static void enqueue_waiting(DesState* des, int student_id) {
+    des->wait_prev[student_id] = des->wait_tail;
+    des->wait_next[student_id] = -1;
+    if (des->wait_tail >= 0) {
+        des->wait_next[des->wait_tail] = student_id;
+    } else {
+        des->wait_head = student_id;
+    }
+    des->wait_tail = student_id;
+}
+
+static void dequeue_waiting(DesState* des, int student_id) {
+    int prev = des->wait_prev[student_id];
+    int next = des->wait_next[student_id];
+    if (prev >= 0) {
+        des->wait_next[prev] = next;
+    } else {
+        des->wait_head = next;
+    }
+    if (next >= 0) {
+        des->wait_prev[next] = prev;
+    } else {
+        des->wait_tail = prev;
+    }
+    des->wait_prev[student_id] = NOT_WAITING;
+}
+
+static void student_leaves_without_teachers(DesState* des, int student_id) {
+    Simulation* sim = des->sim;
+    sim->students_in_school--;
+    record_student_departure(sim, student_id);
+    event_log_emit(sim, student_agent(des, student_id), EVENT_LOG_STUDENT_LEAVE, des_now_ns(des),
+                   (uint64_t)sim->student_lessons_attended[student_id]);
+    log_message(LOG_INFO, "Student %d is leaving because no teachers remain. Lessons attended: %d/%d\n",
+              student_id, sim->student_lessons_attended[student_id], sim->config.required_lessons);
+}
+
+// waited: the teacher went through the wait loop before starting
+static void start_lesson(DesState* des, int classroom_id, bool with_fewer, bool waited) {
+    Simulation* sim = des->sim;
+    Classroom* room = &sim->classrooms[classroom_id];
+    uint64_t now_ns = des_now_ns(des);
+
+    room->state = LESSON_IN_PROGRESS;
+    set_room_open(des, classroom_id, false);
+    des->rooms[classroom_id].serial++; // Invalidate pending timeouts
+
+    log_message(LOG_INFO, "Teacher %d starting lesson in classroom %d with %d students%s.\n",
+               room->teacher_id, classroom_id, room->students_count,
+               with_fewer ? " (fewer than required)" : "");
+
+    event_log_emit(sim, room->teacher_id, EVENT_LOG_LESSON_START, now_ns,
+                   (uint64_t)room->students_count * 2 + (waited ? 1 : 0));
+    for (int i = 0; i < room->students_count; i++) {
+        event_log_emit(sim, student_agent(des, room->roster[i]), EVENT_LOG_LESSON_SEEN, now_ns,
+                       (uint64_t)classroom_id);
+    }
+
+    schedule_event(des, des->now + sim->config.lesson_duration_sec, EVENT_LESSON_END, room->teacher_id, 0);
+}
+
+static void join_classroom(DesState* des, int student_id, int classroom_id) {
+    Simulation* sim = des->sim;
+    Classroom* room = &sim->classrooms[classroom_id];
+
+    classroom_add_student(sim, room, student_id);
+    event_log_emit(sim, student_agent(des, student_id), EVENT_LOG_STUDENT_JOIN, des_now_ns(des),
+                   (uint64_t)classroom_id);
+    log_message(LOG_INFO, "Student %d joined classroom %d. Student count: %d\n",
+               student_id, classroom_id, room->students_count);
+
+    // Signal the teacher; students joining at the same instant still get in
+    if (room->students_count == sim->config.min_students_for_lesson) {
+        schedule_event(des, des->now, EVENT_LESSON_START, room->teacher_id, des->rooms[classroom_id].serial);
+    }
+}
+
+// Body of the teacher's wait loop: start now or keep waiting for students
+static void teacher_check_students(DesState* des, int classroom_id) {
+    Simulation* sim = des->sim;
+    DesClassroom* state = &des->rooms[classroom_id];
+    int teacher_id = sim->classrooms[classroom_id].teacher_id;
+    int available_students = eligible_students_for_classroom(sim, classroom_id);
+
+    bool start_with_fewer = sim->students_in_school < sim->config.min_students_for_lesson;
+    if (available_students < sim->config.min_students_for_lesson) {
+        log_message(LOG_INFO, "Teacher %d detected only %d eligible students remain for classroom %d.\n",
+                  teacher_id, available_students, classroom_id);
+        start_with_fewer = true;
+    }
+
+    if (start_with_fewer || state->wait_count >= MAX_TEACHER_WAITS) {
+        if (state->wait_count >= MAX_TEACHER_WAITS) {
+            log_message(LOG_INFO, "Teacher %d timed out %d times waiting for students. Starting with %d students.\n",
+                      teacher_id, state->wait_count, sim->classrooms[classroom_id].students_count);
+        }
+        start_lesson(des, classroom_id, start_with_fewer, true);
+        return;
+    }
+
+    schedule_event(des, des->now + sim->config.wait_timeout_sec, EVENT_TEACHER_TIMEOUT, teacher_id, state->serial);
+}
+
+static void handle_teacher_open(DesState* des, int teacher_id) {
+    Simulation* sim = des->sim;
+    int classroom_id = teacher_id; // Each teacher has a designated classroom
+    Classroom* room = &sim->classrooms[classroom_id];
+
+    log_message(LOG_INFO, "Teacher %d preparing for lesson %d in classroom %d.\n",
+               teacher_id, des->rooms[classroom_id].lessons_taught + 1, classroom_id);
+
+    room->teacher_id = teacher_id;
+    room->state = LESSON_WAITING;
+    des->rooms[classroom_id].wait_count = 0;
+    event_log_emit(sim, teacher_id, EVENT_LOG_TEACHER_OPEN, des_now_ns(des), (uint64_t)classroom_id);
+
+    if (sim->students_in_school < sim->config.min_students_for_lesson) {
+        start_lesson(des, classroom_id, true, false);
+        return;
+    }
+
+    // Opening the room wakes idle students that may attend it
+    set_room_open(des, classroom_id, true);
+    int student_id = des->wait_head;
+    while (student_id >= 0) {
+        int next = des->wait_next[student_id];
+        if (!student_already_attended_classroom(sim, student_id, classroom_id,
+                                                sim->student_lessons_attended[student_id])) {
+            dequeue_waiting(des, student_id);
+            join_classroom(des, student_id, classroom_id);
+        }
+        student_id = next;
+    }
+
+    if (room->students_count < sim->config.min_students_for_lesson) {
+        teacher_check_students(des, classroom_id);
+    }
+}
+
+static void handle_lesson_start(DesState* des, int teacher_id, unsigned int serial) {
+    Simulation* sim = des->sim;
+    int classroom_id = teacher_id;
+
+    if (serial == des->rooms[classroom_id].serial && sim->classrooms[classroom_id].state == LESSON_WAITING) {
+        start_lesson(des, classroom_id, false, true);
+    }
+}
+
+static void handle_teacher_timeout(DesState* des, int teacher_id, unsigned int serial) {
+    Simulation* sim = des->sim;
+    int classroom_id = teacher_id;
+    DesClassroom* state = &des->rooms[classroom_id];
+
+    if (serial != state->serial || sim->classrooms[classroom_id].state != LESSON_WAITING ||
+        sim->classrooms[classroom_id].students_count >= sim->config.min_students_for_lesson) {
+        return; // The lesson already started or is about to
+    }
+
+    state->wait_count++;
+    event_log_emit(sim, teacher_id, EVENT_LOG_TEACHER_TIMEOUT, des_now_ns(des), (uint64_t)classroom_id);
+    log_message(LOG_DEBUG, "Teacher %d timed out waiting for students (timeout #%d).\n",
+              teacher_id, state->wait_count);
+    teacher_check_students(des, classroom_id);
+}
+
+static void handle_lesson_end(DesState* des, int teacher_id) {
+    Simulation* sim = des->sim;
+    int classroom_id = teacher_id;
+    Classroom* room = &sim->classrooms[classroom_id];
+    DesClassroom* state = &des->rooms[classroom_id];
+
+    room->state = LESSON_ENDED;
+    event_log_emit(sim, teacher_id, EVENT_LOG_LESSON_END, des_now_ns(des), (uint64_t)classroom_id);
+    log_message(LOG_INFO, "Teacher %d ending lesson in classroom %d.\n", teacher_id, classroom_id);
+
+    teacher_history(sim, teacher_id)[state->lessons_taught] = classroom_id;
+    state->lessons_taught++;
+    sim->teacher_lessons_taught[teacher_id] = state->lessons_taught;
+
+    // The teacher prepares the next lesson before the students move on
+    if (state->lessons_taught < sim->config.required_lessons) {
+        schedule_event(des, des->now, EVENT_TEACHER_OPEN, teacher_id, 0);
+    }
+
+    // Record attendance for everyone who was in the lesson
+    for (int i = 0; i < room->students_count; i++) {
+        int student_id = room->roster[i];
+        event_log_emit(sim, student_agent(des, student_id), EVENT_LOG_STUDENT_COMPLETE, des_now_ns(des),
+                       (uint64_t)classroom_id);
+        int lessons_attended = record_student_lesson(sim, student_id, classroom_id);
+
+        log_message(LOG_INFO, "Student %d completed lesson in classroom %d. Lessons attended: %d/%d\n",
+                   student_id, classroom_id, lessons_attended, sim->config.required_lessons);
+
+        if (lessons_attended < sim->config.required_lessons) {
+            schedule_event(des, des->now, EVENT_STUDENT_SEARCH, student_id, 0);
+            continue;
+        }
+
+        sim->students_in_school--;
+        event_log_emit(sim, student_agent(des, student_id), EVENT_LOG_STUDENT_LEAVE, des_now_ns(des),
+                       (uint64_t)lessons_attended);
+        log_message(LOG_INFO, "Student %d has completed all required lessons and is leaving. Students remaining: %d\n",
+                   student_id, sim->students_in_school);
+    }
+
+    classroom_reset_students(room);
+    room->teacher_id = -1;
+
+    if (state->lessons_taught < sim->config.required_lessons) {
+        return;
+    }
+
+    sim->remaining_teachers--;
+    event_log_emit(sim, teacher_id, EVENT_LOG_TEACHER_LEAVE, des_now_ns(des), (uint64_t)state->lessons_taught);
+    log_message(LOG_INFO, "Teacher %d has completed all required lessons and is leaving. Teachers remaining: %d\n",
+               teacher_id, sim->remaining_teachers);
+
+    if (sim->remaining_teachers == 0) {
+        while (des->wait_head >= 0) {
+            int student_id = des->wait_head;
+            dequeue_waiting(des, student_id);
+            student_leaves_without_teachers(des, student_id);
+        }
+    }
+}
+
+static void handle_student_search(DesState* des, int student_id) {
+    Simulation* sim = des->sim;
+    event_log_emit(sim, student_agent(des, student_id), EVENT_LOG_STUDENT_SEARCH, des_now_ns(des), 0);
+    if (sim->remaining_teachers == 0) {
+        student_leaves_without_teachers(des, student_id);
+        return;
+    }
+
+    int classroom_id = find_classroom_for(des, student_id);
+    if (classroom_id >= 0) {
+        join_classroom(des, student_id, classroom_id);
+    } else {
+        enqueue_waiting(des, student_id);
+    }
+}
+
+// Run one simulation on a single thread with an event calendar
+void run_des_engine(Simulation* sim) {
+    DesState state;
+    DesState* des = &state;
+    memset(des, 0, sizeof(*des));
+    des->sim = sim;
+
+    des->rooms = checked_calloc((size_t)sim->config.num_classes, sizeof(DesClassroom), "event engine classrooms");
+    des->open_words = ((size_t)sim->config.num_classes + 63) / 64;
+    des->open_rooms = checked_calloc(des->open_words, sizeof(uint64_t), "open classroom bitmap");
+    des->wait_next = checked_calloc((size_t)sim->config.total_students, sizeof(int), "student wait queue");
+    des->wait_prev = checked_calloc((size_t)sim->config.total_students, sizeof(int), "student wait queue");
+    des->wait_head = -1;
+    des->wait_tail = -1;
+
+    for (int i = 0; i < sim->config.num_classes; i++) {
+        sim->classrooms[i].id = i;
+        sim->classrooms[i].state = LESSON_WAITING;
+        sim->classrooms[i].teacher_id = -1;
+        classroom_reset_students(&sim->classrooms[i]);
+    }
+    for (int i = 0; i < sim->config.total_students; i++) {
+        des->wait_prev[i] = NOT_WAITING;
+    }
+
+    // Agents arrive in the same order the threaded engine creates them
+    for (int i = 0; i < sim->config.num_teachers; i++) {
+        log_message(LOG_INFO, "Teacher %d has arrived at school.\n", i);
+        schedule_event(des, 0.0, EVENT_TEACHER_OPEN, i, 0);
+    }
+    for (int i = 0; i < sim->config.total_students; i++) {
+        log_message(LOG_INFO, "Student %d has arrived at school.\n", i);
+        schedule_event(des, 0.0, EVENT_STUDENT_SEARCH, i, 0);
+    }
+
+    Event ev;
+    while (next_event(des, &ev)) {
+        des->now = ev.time;
+        des->events_processed++;
+
+        switch (ev.type) {
+            case EVENT_TEACHER_OPEN:
+                handle_teacher_open(des, ev.agent);
+                break;
+            case EVENT_TEACHER_TIMEOUT:
+                handle_teacher_timeout(des, ev.agent, ev.serial);
+                break;
+            case EVENT_LESSON_START:
+                handle_lesson_start(des, ev.agent, ev.serial);
+                break;
+            case EVENT_LESSON_END:
+                handle_lesson_end(des, ev.agent);
+                break;
+            case EVENT_STUDENT_SEARCH:
+                handle_student_search(des, ev.agent);
+                break;
+        }
+    }
+
+    log_message(LOG_INFO, "Discrete-event engine processed %llu events over %.3f simulated seconds.\n",
+               des->events_processed, des->now);
+    sim->result.simulated_sec = des->now;
+
+    free(des->rooms);
+    free(des->open_rooms);
+    free(des->wait_next);
+    free(des->wait_prev);
+    free(des->calendar.events);
+}
@@ -0,0 +1,195 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zso.h"
+
+// Binary event log (--event-log=FILE), read back by zso_replay.
+//
+// Agents append events to a small buffer of their own: a type byte, the
+// time since the agent's previous event and one argument, both as LEB128
+// varints, so a typical event takes three or four bytes and recording
+// needs no lock. A full buffer is written to the file as one chunk under
+// the log mutex, and whatever is left is flushed when the run ends. The
+// file is written through a large stdio buffer and holds every run of the
+// process:
+//
+//   file   = EVENT_LOG_MAGIC record*
+//   record = RUN_BEGIN run classes students_per_class min_students lessons engine
+//          | CHUNK run agent base_ns length event*
+//          | RUN_END run simulated_ns
+//   event  = type delta_ns argument
+//
+// All numbers are varints. Agents are numbered teachers first, then
+// students; an event's delta is relative to the previous event of the same
+// chunk, the first one to the chunk's base_ns. Chunks of one agent appear
+// in order, and chunks of concurrent runs may interleave.
+
+#define EVENT_LOG_CHUNK_BYTES 512
+#define EVENT_LOG_MAX_EVENT_BYTES (1 + 2 * EVENT_LOG_MAX_VARINT)
+#define EVENT_LOG_FILE_BUFFER (1 << 20)
+
+struct EventBuffer {
+    uint64_t base_ns;  // Time of the chunk's first event
+    uint64_t last_ns;  // Time of the previous event
+    size_t used;
+    uint8_t data[EVENT_LOG_CHUNK_BYTES];
+};
+
+static struct {
+    pthread_mutex_t mutex;  // Serializes records written to file
+    FILE* file;
+    char* file_buffer;
+} event_log = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+size_t varint_encode(uint64_t value, uint8_t* out) {
+    size_t length = 0;
+    while (value >= 0x80) {
+        out[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (uint8_t)value;
+    return length;
+}
+
+static int agent_count(const Simulation* sim) {
+    return sim->config.num_teachers + sim->config.total_students;
+}
+
+// Write one record. Caller holds event_log.mutex.
+static void write_record(const uint8_t* header, size_t header_length, const uint8_t* payload, size_t payload_length) {
+    if (fwrite(header, 1, header_length, event_log.file) != header_length ||
+        (payload_length > 0 && fwrite(payload, 1, payload_length, event_log.file) != payload_length)) {
+        fprintf(stderr, "Failed to write event log: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Open the log file of the process if --event-log is set
+void event_log_open(void) {
+    if (config.event_log_path == NULL) {
+        return;
+    }
+
+    event_log.file = fopen(config.event_log_path, "wb");
+    if (event_log.file == NULL) {
+        fprintf(stderr, "Cannot open event log '%s': %s\n", config.event_log_path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    event_log.file_buffer = checked_calloc(EVENT_LOG_FILE_BUFFER, 1, "event log buffer");
+    setvbuf(event_log.file, event_log.file_buffer, _IOFBF, EVENT_LOG_FILE_BUFFER);
+    write_record((const uint8_t*)EVENT_LOG_MAGIC, EVENT_LOG_MAGIC_LENGTH, NULL, 0);
+}
+
+void event_log_close(void) {
+    if (event_log.file == NULL) {
+        return;
+    }
+    if (fclose(event_log.file) != 0) {
+        fprintf(stderr, "Failed to write event log: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    free(event_log.file_buffer);
+    event_log.file = NULL;
+    event_log.file_buffer = NULL;
+}
+
+void event_log_init(Simulation* sim) {
+    if (event_log.file != NULL) {
+        sim->event_buffers = checked_calloc((size_t)agent_count(sim), sizeof(EventBuffer), "event buffers");
+    }
+}
+
+void event_log_free(Simulation* sim) {
+    free(sim->event_buffers);
+}
+
+// Write an agent's pending events as a chunk
+static void flush_buffer(Simulation* sim, int agent) {
+    EventBuffer* buffer = &sim->event_buffers[agent];
+    if (buffer->used == 0) {
+        return;
+    }
+
+    uint8_t header[1 + 4 * EVENT_LOG_MAX_VARINT];
+    size_t length = 0;
+    header[length++] = EVENT_LOG_RECORD_CHUNK;
+    length += varint_encode((uint64_t)sim->run_id, header + length);
+    length += varint_encode((uint64_t)agent, header + length);
+    length += varint_encode(buffer->base_ns, header + length);
+    length += varint_encode(buffer->used, header + length);
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&event_log.mutex), "Event log: lock for chunk");
+    write_record(header, length, buffer->data, buffer->used);
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&event_log.mutex), "Event log: unlock for chunk");
+
+    buffer->used = 0;
+}
+
+// Start logging a run: announce its configuration
+void event_log_begin_run(Simulation* sim) {
+    const SimConfig* run_config = &sim->config;
+    uint64_t fields[] = {
+        (uint64_t)sim->run_id, (uint64_t)run_config->num_classes, (uint64_t)run_config->students_per_class,
+        (uint64_t)run_config->min_students_for_lesson, (uint64_t)run_config->required_lessons,
+        (uint64_t)run_config->engine,
+    };
+    uint8_t header[1 + sizeof(fields) / sizeof(fields[0]) * EVENT_LOG_MAX_VARINT];
+    size_t length = 0;
+    header[length++] = EVENT_LOG_RECORD_RUN_BEGIN;
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        length += varint_encode(fields[i], header + length);
+    }
+
+    memset(sim->event_buffers, 0, (size_t)agent_count(sim) * sizeof(EventBuffer));
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&event_log.mutex), "Event log: lock for run start");
+    write_record(header, length, NULL, 0);
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&event_log.mutex), "Event log: unlock for run start");
+}
+
+// Flush every agent's remaining events and close the run. Called after
+// all agents have finished.
+void event_log_end_run(Simulation* sim) {
+    for (int agent = 0; agent < agent_count(sim); agent++) {
+        flush_buffer(sim, agent);
+    }
+
+    uint8_t header[1 + 2 * EVENT_LOG_MAX_VARINT];
+    size_t length = 0;
+    header[length++] = EVENT_LOG_RECORD_RUN_END;
+    length += varint_encode((uint64_t)sim->run_id, header + length);
+    length += varint_encode((uint64_t)(sim->result.simulated_sec * NSEC_PER_SEC), header + length);
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&event_log.mutex), "Event log: lock for run end");
+    write_record(header, length, NULL, 0);
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&event_log.mutex), "Event log: unlock for run end");
+}
+
+// Append an event of an agent (teachers first, then students) at simulated
+// time now_ns. Called only by that agent.
+void event_log_emit(Simulation* sim, int agent, int type, uint64_t now_ns, uint64_t argument) {
+    if (sim->event_buffers == NULL) {
+        return;
+    }
+
+    EventBuffer* buffer = &sim->event_buffers[agent];
+    if (buffer->used + EVENT_LOG_MAX_EVENT_BYTES > EVENT_LOG_CHUNK_BYTES) {
+        flush_buffer(sim, agent);
+    }
+    if (buffer->used == 0) {
+        buffer->base_ns = now_ns;
+        buffer->last_ns = now_ns;
+    }
+
+    // Clocks never run backwards, but keep the delta unsigned regardless
+    uint64_t delta = now_ns > buffer->last_ns ? now_ns - buffer->last_ns : 0;
+    buffer->last_ns += delta;
+
+    buffer->data[buffer->used++] = (uint8_t)type;
+    buffer->used += varint_encode(delta, buffer->data + buffer->used);
+    buffer->used += varint_encode(argument, buffer->data + buffer->used);
+}
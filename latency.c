@@ -0,0 +1,144 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zso.h"
+
+// Latency distributions of the thread engines.
+//
+// Every agent records its own samples, one slot per lesson, into arrays
+// nobody else writes, so the hot path is a single store without locks or
+// shared counters. After the agents are joined the samples of each metric
+// are merged into a log-linear (HDR-style) histogram: values below
+// LATENCY_SUB_BUCKETS nanoseconds are exact, larger ones fall into one of
+// LATENCY_SUB_BUCKETS buckets per power of two, i.e. within 1/128 of their
+// value. Percentiles report the upper bound of their bucket.
+
+#define LATENCY_SUB_BITS 7
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+#define LATENCY_NONE UINT64_MAX  // Slot of a lesson that was never reached
+
+struct LatencyHistogram {
+    unsigned long long counts[LATENCY_BUCKETS];
+    unsigned long long total;
+    uint64_t max;
+};
+
+static const char* const metric_names[LATENCY_METRICS] = {
+    "Student search to join",
+    "Student join to lesson start",
+    "Teacher wait for students",
+    "Student lesson turnaround",
+};
+
+static int bucket_index(uint64_t value) {
+    if (value < LATENCY_SUB_BUCKETS) {
+        return (int)value;
+    }
+    int shift = 63 - __builtin_clzll(value) - LATENCY_SUB_BITS;
+    return (shift + 1) * LATENCY_SUB_BUCKETS + (int)((value >> shift) - LATENCY_SUB_BUCKETS);
+}
+
+// Largest value that falls into bucket index
+static uint64_t bucket_upper_bound(int index) {
+    if (index < LATENCY_SUB_BUCKETS) {
+        return (uint64_t)index;
+    }
+    int shift = index / LATENCY_SUB_BUCKETS - 1;
+    uint64_t sub = (uint64_t)(index % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS);
+    return ((sub + 1) << shift) - 1;
+}
+
+// Metrics recorded by teachers are indexed by teacher id, all others by student id
+static size_t metric_owners(const SimConfig* config, int metric) {
+    return (size_t)(metric == LATENCY_TEACHER_WAIT ? config->num_teachers : config->total_students);
+}
+
+void latency_init(Simulation* sim) {
+    size_t lessons = (size_t)sim->config.required_lessons;
+    for (int metric = 0; metric < LATENCY_METRICS; metric++) {
+        sim->latency_samples[metric] = checked_calloc(metric_owners(&sim->config, metric) * lessons,
+                                                      sizeof(uint64_t), "latency samples");
+    }
+    sim->latency_histogram = checked_calloc(1, sizeof(LatencyHistogram), "latency histogram");
+}
+
+void latency_free(Simulation* sim) {
+    for (int metric = 0; metric < LATENCY_METRICS; metric++) {
+        free(sim->latency_samples[metric]);
+    }
+    free(sim->latency_histogram);
+}
+
+// Mark every slot empty before a run
+void latency_reset(Simulation* sim) {
+    size_t lessons = (size_t)sim->config.required_lessons;
+    for (int metric = 0; metric < LATENCY_METRICS; metric++) {
+        uint64_t* samples = sim->latency_samples[metric];
+        size_t count = metric_owners(&sim->config, metric) * lessons;
+        for (size_t i = 0; i < count; i++) {
+            samples[i] = LATENCY_NONE;
+        }
+    }
+}
+
+// Record the latency of an agent's lesson-th lesson; called only by that agent
+void latency_record(Simulation* sim, int metric, int agent_id, int lesson, uint64_t latency_ns) {
+    sim->latency_samples[metric][(size_t)agent_id * (size_t)sim->config.required_lessons + (size_t)lesson] =
+        latency_ns;
+}
+
+// Smallest bucket bound covering percent of the samples
+static double percentile_sec(const LatencyHistogram* histogram, int percent) {
+    unsigned long long rank = (histogram->total * (unsigned long long)percent + 99) / 100;
+
+    unsigned long long seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            uint64_t bound = bucket_upper_bound(i);
+            return (double)(bound < histogram->max ? bound : histogram->max) / NSEC_PER_SEC;
+        }
+    }
+    return (double)histogram->max / NSEC_PER_SEC;
+}
+
+// Merge the samples of a finished run into its percentile summaries
+void latency_collect(Simulation* sim) {
+    LatencyHistogram* histogram = sim->latency_histogram;
+    size_t lessons = (size_t)sim->config.required_lessons;
+
+    for (int metric = 0; metric < LATENCY_METRICS; metric++) {
+        memset(histogram, 0, sizeof(LatencyHistogram));
+
+        const uint64_t* samples = sim->latency_samples[metric];
+        size_t count = metric_owners(&sim->config, metric) * lessons;
+        for (size_t i = 0; i < count; i++) {
+            if (samples[i] == LATENCY_NONE) {
+                continue;
+            }
+            histogram->counts[bucket_index(samples[i])]++;
+            histogram->total++;
+            if (samples[i] > histogram->max) {
+                histogram->max = samples[i];
+            }
+        }
+
+        LatencySummary* summary = &sim->result.latency[metric];
+        summary->count = (long long)histogram->total;
+        summary->p50_sec = histogram->total > 0 ? percentile_sec(histogram, 50) : 0;
+        summary->p99_sec = histogram->total > 0 ? percentile_sec(histogram, 99) : 0;
+        summary->max_sec = (double)histogram->max / NSEC_PER_SEC;
+    }
+}
+
+void print_latency_report(const Simulation* sim, FILE* out) {
+    fprintf(out, "\nLatency (ms):                        samples        p50        p99        max\n");
+    for (int metric = 0; metric < LATENCY_METRICS; metric++) {
+        const LatencySummary* summary = &sim->result.latency[metric];
+        fprintf(out, "  %-32s %10lld %10.3f %10.3f %10.3f\n", metric_names[metric], summary->count,
+                summary->p50_sec * 1e3, summary->p99_sec * 1e3, summary->max_sec * 1e3);
+    }
+}
@@ -0,0 +1,192 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zso.h"
+
+// Instrumented locking for the school and classroom mutexes.
+//
+// With --lock-stats=on every LOCK_MUTEX first tries the lock; only when
+// that fails (a "trylock failure", i.e. contention) is the blocking
+// acquisition timed, so uncontended locks cost one extra clock read.
+// Counters are kept per mutex and per call site. Hold time is charged to
+// the site that acquired the mutex and pauses while the holder waits on a
+// condition variable.
+
+#define LOCK_REPORT_TOP_CLASSROOMS 10
+
+// Call site names; ids index Simulation.lock_sites
+static const char* site_names[MAX_LOCK_SITES];
+static SiteRegistry site_registry = SITE_REGISTRY_INITIALIZER(site_names, MAX_LOCK_SITES);
+
+static int lock_site_id(LockSite* site) {
+    return site_registry_id(&site_registry, &site->id, site->name);
+}
+
+// The statistics belonging to a simulation mutex: the school mutex or the
+// mutex embedded in one of its classrooms
+static MutexStats* mutex_stats_for(Simulation* sim, pthread_mutex_t* mutex) {
+    if (mutex == &sim->school_mutex) {
+        return &sim->school_lock_stats;
+    }
+    Classroom* room = (Classroom*)((char*)mutex - offsetof(Classroom, mutex));
+    return &room->lock_stats;
+}
+
+static void add_counter(_Atomic unsigned long long* counter, unsigned long long value) {
+    atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+}
+
+void lock_mutex(Simulation* sim, pthread_mutex_t* mutex, LockSite* site) {
+    counter_add(COUNTER_LOCKS);
+    if (!sim->config.lock_stats) {
+        CHECK_PTHREAD_RETURN(pthread_mutex_lock(mutex), site->name);
+        return;
+    }
+
+    int id = lock_site_id(site);
+    LockCounters* site_counters = &sim->lock_sites[id];
+    uint64_t wait_ns = 0;
+    uint64_t now;
+
+    int result = pthread_mutex_trylock(mutex);
+    if (result == EBUSY) {
+        uint64_t start = monotonic_ns();
+        CHECK_PTHREAD_RETURN(pthread_mutex_lock(mutex), site->name);
+        now = monotonic_ns();
+        wait_ns = now - start;
+    } else {
+        CHECK_PTHREAD_RETURN(result, site->name);
+        now = monotonic_ns();
+    }
+
+    MutexStats* stats = mutex_stats_for(sim, mutex);
+    stats->locked_at_ns = now;
+    stats->locked_site = id;
+
+    add_counter(&stats->counters.acquisitions, 1);
+    add_counter(&site_counters->acquisitions, 1);
+    if (result == EBUSY) {
+        add_counter(&stats->counters.trylock_failures, 1);
+        add_counter(&site_counters->trylock_failures, 1);
+        add_counter(&stats->counters.wait_ns, wait_ns);
+        add_counter(&site_counters->wait_ns, wait_ns);
+    }
+}
+
+// Charge the time since the mutex was (re)acquired to its holder. Caller holds mutex.
+static void end_hold(Simulation* sim, MutexStats* stats) {
+    uint64_t hold_ns = monotonic_ns() - stats->locked_at_ns;
+    add_counter(&stats->counters.hold_ns, hold_ns);
+    add_counter(&sim->lock_sites[stats->locked_site].hold_ns, hold_ns);
+}
+
+void unlock_mutex(Simulation* sim, pthread_mutex_t* mutex, const char* msg) {
+    if (sim->config.lock_stats) {
+        end_hold(sim, mutex_stats_for(sim, mutex));
+    }
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(mutex), msg);
+}
+
+// A condition wait releases the mutex; hold time stops until it returns
+void lock_wait_begin(Simulation* sim, pthread_mutex_t* mutex) {
+    if (sim->config.lock_stats) {
+        end_hold(sim, mutex_stats_for(sim, mutex));
+    }
+}
+
+void lock_wait_end(Simulation* sim, pthread_mutex_t* mutex) {
+    if (sim->config.lock_stats) {
+        mutex_stats_for(sim, mutex)->locked_at_ns = monotonic_ns();
+    }
+}
+
+// Clear all counters before a run
+void lock_stats_reset(Simulation* sim) {
+    if (!sim->config.lock_stats) {
+        return;
+    }
+    memset(sim->lock_sites, 0, MAX_LOCK_SITES * sizeof(LockCounters));
+    memset(&sim->school_lock_stats, 0, sizeof(MutexStats));
+    for (int i = 0; i < sim->config.num_classes; i++) {
+        memset(&sim->classrooms[i].lock_stats, 0, sizeof(MutexStats));
+    }
+}
+
+static void print_counters(FILE* out, const char* label, LockCounters* counters) {
+    fprintf(out, "  %-50s %10llu %13llu %12.3f %12.3f\n", label,
+            atomic_load(&counters->acquisitions), atomic_load(&counters->trylock_failures),
+            atomic_load(&counters->wait_ns) / 1e6, atomic_load(&counters->hold_ns) / 1e6);
+}
+
+// Call site and its wait time, for sorting
+typedef struct {
+    int id;
+    unsigned long long wait_ns;
+} SiteWait;
+
+static int compare_site_wait_desc(const void* a, const void* b) {
+    unsigned long long wait_a = ((const SiteWait*)a)->wait_ns;
+    unsigned long long wait_b = ((const SiteWait*)b)->wait_ns;
+    return (wait_a < wait_b) - (wait_a > wait_b);
+}
+
+static int compare_classroom_wait_desc(const void* a, const void* b) {
+    const Classroom* room_a = *(Classroom* const*)a;
+    const Classroom* room_b = *(Classroom* const*)b;
+    unsigned long long wait_a = atomic_load(&room_a->lock_stats.counters.wait_ns);
+    unsigned long long wait_b = atomic_load(&room_b->lock_stats.counters.wait_ns);
+    return (wait_a < wait_b) - (wait_a > wait_b);
+}
+
+// Print per-mutex and per-call-site contention for the finished run
+void print_lock_report(Simulation* sim, FILE* out) {
+    if (!sim->config.lock_stats || sim->config.engine == ENGINE_DES) {
+        return;
+    }
+
+    fprintf(out, "\nLock contention:\n");
+    fprintf(out, "  %-50s %10s %13s %12s %12s\n", "Mutex", "Acquired", "Trylock fails", "Wait (ms)", "Hold (ms)");
+    print_counters(out, "school", &sim->school_lock_stats.counters);
+
+    Classroom** rooms = checked_calloc((size_t)sim->config.num_classes, sizeof(Classroom*), "lock report");
+    for (int i = 0; i < sim->config.num_classes; i++) {
+        rooms[i] = &sim->classrooms[i];
+    }
+    qsort(rooms, (size_t)sim->config.num_classes, sizeof(Classroom*), compare_classroom_wait_desc);
+
+    int shown = sim->config.num_classes < LOCK_REPORT_TOP_CLASSROOMS ? sim->config.num_classes
+                                                                      : LOCK_REPORT_TOP_CLASSROOMS;
+    for (int i = 0; i < shown; i++) {
+        char label[32];
+        snprintf(label, sizeof(label), "classroom %d", rooms[i]->id);
+        print_counters(out, label, &rooms[i]->lock_stats.counters);
+    }
+    if (shown < sim->config.num_classes) {
+        fprintf(out, "  ... %d more classrooms with less wait time\n", sim->config.num_classes - shown);
+    }
+    free(rooms);
+
+    int site_count = site_registry_count(&site_registry);
+
+    SiteWait order[MAX_LOCK_SITES];
+    int used = 0;
+    for (int i = 0; i < site_count; i++) {
+        if (atomic_load(&sim->lock_sites[i].acquisitions) > 0) {
+            order[used].id = i;
+            order[used].wait_ns = atomic_load(&sim->lock_sites[i].wait_ns);
+            used++;
+        }
+    }
+    qsort(order, (size_t)used, sizeof(SiteWait), compare_site_wait_desc);
+
+    fprintf(out, "\n  %-50s %10s %13s %12s %12s\n", "Call site", "Acquired", "Trylock fails", "Wait (ms)", "Hold (ms)");
+    for (int i = 0; i < used; i++) {
+        print_counters(out, site_names[order[i].id], &sim->lock_sites[order[i].id]);
+    }
+}
@@ -0,0 +1,367 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "zso.h"
+
+// Asynchronous logging.
+//
+// Every thread that logs owns a single-producer/single-consumer ring of binary
+// records (timestamp, format pointer, raw arguments). log_message() never
+// takes a lock or formats text: it copies the arguments into the ring, or
+// drops the record if the ring is full. A writer thread drains all rings,
+// orders each batch by timestamp, formats it and writes it with one fwrite.
+// Format strings must be literals (they are read after the call returns).
+
+#define LOG_RING_CAPACITY 1024 // Records per thread, must be a power of two
+#define LOG_MAX_ARGS 8
+#define LOG_LINE_MAX 512
+#define LOG_IDLE_SLEEP_NS 1000000L
+
+// Ring states
+#define RING_IN_USE 0  // Owned by a live thread
+#define RING_RETIRED 1 // Owner exited, records may remain
+#define RING_FREE 2    // Drained, can be handed to a new thread
+
+typedef union {
+    long long i;
+    double d;
+    const void* p;
+} LogArg;
+
+typedef struct {
+    uint64_t timestamp_ns;
+    uint64_t order;     // Set by the writer: keeps per-thread order for equal timestamps
+    const char* format;
+    LogArg args[LOG_MAX_ARGS];
+} LogRecord;
+
+typedef struct LogRing {
+    LogRecord records[LOG_RING_CAPACITY];
+    _Atomic uint64_t head;      // Next record the writer reads
+    _Atomic uint64_t tail;      // Next record the owner writes
+    _Atomic uint64_t dropped;
+    _Atomic int state;
+    struct LogRing* next;       // Registry list, never shrinks
+    struct LogRing* next_free;
+} LogRing;
+
+static struct {
+    pthread_mutex_t registry_mutex; // Guards ring registration only
+    LogRing* rings;
+    LogRing* free_rings;
+    pthread_key_t ring_key;
+    pthread_t writer;
+    bool running;
+    _Atomic bool stop;
+    _Atomic uint64_t passes;    // Completed writer passes, used by log_flush
+    uint64_t start_ns;
+    uint64_t reported_drops;
+} logger = { .registry_mutex = PTHREAD_MUTEX_INITIALIZER };
+
+static _Thread_local LogRing* thread_ring = NULL;
+
+// Called when a logging thread exits
+static void retire_ring(void* ring) {
+    atomic_store_explicit(&((LogRing*)ring)->state, RING_RETIRED, memory_order_release);
+}
+
+static LogRing* acquire_ring() {
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&logger.registry_mutex), "Logger: registry lock");
+
+    LogRing* ring = logger.free_rings;
+    if (ring != NULL) {
+        logger.free_rings = ring->next_free;
+    } else {
+        ring = checked_calloc(1, sizeof(LogRing), "log ring");
+        ring->next = logger.rings;
+        logger.rings = ring;
+    }
+    atomic_store_explicit(&ring->state, RING_IN_USE, memory_order_relaxed);
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&logger.registry_mutex), "Logger: registry unlock");
+
+    CHECK_PTHREAD_RETURN(pthread_setspecific(logger.ring_key, ring), "Logger: ring registration");
+    return ring;
+}
+
+// Parse the conversion spec starting at `format` (which points at '%').
+// Copies it to `spec`, stores the conversion character and returns the
+// position after it, or NULL for a malformed trailing spec.
+static const char* parse_spec(const char* format, char* spec, size_t spec_size, char* conversion) {
+    const char* end = format + 1;
+    while (*end != '\0' && strchr("-+ #0123456789.hlzjt", *end) != NULL) {
+        end++;
+    }
+    if (*end == '\0') {
+        return NULL;
+    }
+
+    size_t length = (size_t)(end - format) + 1;
+    if (length >= spec_size) {
+        length = spec_size - 1;
+    }
+    memcpy(spec, format, length);
+    spec[length] = '\0';
+    *conversion = *end;
+    return end + 1;
+}
+
+static bool spec_is_long_long(const char* spec) {
+    return strstr(spec, "ll") != NULL || strchr(spec, 'z') != NULL || strchr(spec, 'j') != NULL;
+}
+
+void log_message(int level, const char* format, ...) {
+    if (level > config.log_level || !logger.running) {
+        return;
+    }
+
+    LogRing* ring = thread_ring;
+    if (ring == NULL) {
+        ring = thread_ring = acquire_ring();
+    }
+
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail - head == LOG_RING_CAPACITY) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    LogRecord* record = &ring->records[tail & (LOG_RING_CAPACITY - 1)];
+    record->timestamp_ns = monotonic_ns();
+    record->format = format;
+
+    va_list args;
+    va_start(args, format);
+
+    char spec[32];
+    char conversion;
+    int i = 0;
+    for (const char* cursor = format; *cursor != '\0' && i < LOG_MAX_ARGS;) {
+        if (cursor[0] != '%' || cursor[1] == '%') {
+            cursor += cursor[0] == '%' ? 2 : 1;
+            continue;
+        }
+        cursor = parse_spec(cursor, spec, sizeof(spec), &conversion);
+        if (cursor == NULL) {
+            break;
+        }
+
+        if (strchr("fFeEgGaA", conversion) != NULL) {
+            record->args[i].d = va_arg(args, double);
+        } else if (conversion == 's' || conversion == 'p') {
+            record->args[i].p = va_arg(args, const void*);
+        } else if (spec_is_long_long(spec)) {
+            record->args[i].i = va_arg(args, long long);
+        } else if (strchr(spec, 'l') != NULL) {
+            record->args[i].i = va_arg(args, long);
+        } else {
+            record->args[i].i = va_arg(args, int);
+        }
+        i++;
+    }
+    va_end(args);
+
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+// Format a record into `out`, replaying the arguments captured by log_message
+static int format_record(const LogRecord* record, char* out, size_t size) {
+    double seconds = (double)(record->timestamp_ns - logger.start_ns) / NSEC_PER_SEC;
+    size_t written = (size_t)snprintf(out, size, "[%12.6f] ", seconds);
+
+    char spec[32];
+    char conversion;
+    int i = 0;
+    const char* cursor = record->format;
+    while (*cursor != '\0' && written < size - 1) {
+        if (cursor[0] != '%' || cursor[1] == '%') {
+            out[written++] = cursor[0];
+            cursor += cursor[0] == '%' ? 2 : 1;
+            continue;
+        }
+
+        cursor = parse_spec(cursor, spec, sizeof(spec), &conversion);
+        if (cursor == NULL || i >= LOG_MAX_ARGS) {
+            break;
+        }
+
+        const LogArg* arg = &record->args[i++];
+        char* dest = out + written;
+        size_t room = size - written;
+        int n;
+        if (strchr("fFeEgGaA", conversion) != NULL) {
+            n = snprintf(dest, room, spec, arg->d);
+        } else if (conversion == 's' || conversion == 'p') {
+            n = snprintf(dest, room, spec, arg->p);
+        } else if (spec_is_long_long(spec)) {
+            n = snprintf(dest, room, spec, arg->i);
+        } else if (strchr(spec, 'l') != NULL) {
+            n = snprintf(dest, room, spec, (long)arg->i);
+        } else {
+            n = snprintf(dest, room, spec, (int)arg->i);
+        }
+        written += n > 0 ? (size_t)n : 0;
+        if (written >= size) {
+            written = size - 1;
+        }
+    }
+    out[written] = '\0';
+    return (int)written;
+}
+
+static int compare_records(const void* a, const void* b) {
+    const LogRecord* ra = a;
+    const LogRecord* rb = b;
+    if (ra->timestamp_ns != rb->timestamp_ns) {
+        return ra->timestamp_ns < rb->timestamp_ns ? -1 : 1;
+    }
+    return (ra->order > rb->order) - (ra->order < rb->order);
+}
+
+// Drain every ring once and write the batch. Returns the number of records written.
+static size_t writer_pass(LogRecord** batch, size_t* batch_capacity, char** text, size_t* text_capacity) {
+    size_t count = 0;
+    uint64_t drops = 0;
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&logger.registry_mutex), "Logger: registry lock");
+    LogRing* rings = logger.rings;
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&logger.registry_mutex), "Logger: registry unlock");
+
+    // Rings are only ever prepended, so the snapshot stays valid
+    for (LogRing* ring = rings; ring != NULL; ring = ring->next) {
+        int state = atomic_load_explicit(&ring->state, memory_order_acquire);
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+        if (count + (tail - head) > *batch_capacity) {
+            *batch_capacity = (count + (tail - head)) * 2;
+            *batch = realloc(*batch, *batch_capacity * sizeof(LogRecord));
+            if (*batch == NULL) {
+                fprintf(stderr, "Failed to allocate memory for log batch\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        for (; head != tail; head++) {
+            (*batch)[count] = ring->records[head & (LOG_RING_CAPACITY - 1)];
+            (*batch)[count].order = count;
+            count++;
+        }
+        atomic_store_explicit(&ring->head, head, memory_order_release);
+        drops += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+
+        // A retired ring is empty once drained and can be reused
+        if (state == RING_RETIRED) {
+            atomic_store_explicit(&ring->state, RING_FREE, memory_order_relaxed);
+            CHECK_PTHREAD_RETURN(pthread_mutex_lock(&logger.registry_mutex), "Logger: registry lock");
+            ring->next_free = logger.free_rings;
+            logger.free_rings = ring;
+            CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&logger.registry_mutex), "Logger: registry unlock");
+        }
+    }
+
+    if (count > 0) {
+        qsort(*batch, count, sizeof(LogRecord), compare_records);
+
+        if (*text_capacity < count * LOG_LINE_MAX) {
+            *text_capacity = count * LOG_LINE_MAX;
+            *text = realloc(*text, *text_capacity);
+            if (*text == NULL) {
+                fprintf(stderr, "Failed to allocate memory for log text\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        size_t length = 0;
+        for (size_t i = 0; i < count; i++) {
+            length += (size_t)format_record(&(*batch)[i], *text + length, LOG_LINE_MAX);
+        }
+        fwrite(*text, 1, length, stdout);
+        fflush(stdout);
+    }
+
+    if (drops > logger.reported_drops) {
+        fprintf(stderr, "[log] %llu records dropped (ring full)\n",
+                (unsigned long long)(drops - logger.reported_drops));
+        logger.reported_drops = drops;
+    }
+    return count;
+}
+
+static void* writer_function(void* arg) {
+    (void)arg;
+    LogRecord* batch = NULL;
+    size_t batch_capacity = 0;
+    char* text = NULL;
+    size_t text_capacity = 0;
+
+    for (;;) {
+        bool stopping = atomic_load_explicit(&logger.stop, memory_order_acquire);
+        size_t written = writer_pass(&batch, &batch_capacity, &text, &text_capacity);
+        atomic_fetch_add_explicit(&logger.passes, 1, memory_order_release);
+
+        if (stopping && written == 0) {
+            break;
+        }
+        if (written == 0) {
+            struct timespec idle = { 0, LOG_IDLE_SLEEP_NS };
+            nanosleep(&idle, NULL);
+        }
+    }
+
+    free(batch);
+    free(text);
+    return NULL;
+}
+
+// Start the writer thread if logging is enabled
+void log_init() {
+    if (config.log_level < LOG_INFO) {
+        return;
+    }
+
+    logger.start_ns = monotonic_ns();
+    CHECK_PTHREAD_RETURN(pthread_key_create(&logger.ring_key, retire_ring), "Logger: key creation");
+    logger.running = true;
+    CHECK_PTHREAD_RETURN(pthread_create(&logger.writer, NULL, writer_function, NULL),
+                        "Logger: writer thread creation");
+}
+
+// Wait until everything logged so far has been written
+void log_flush() {
+    if (!logger.running) {
+        return;
+    }
+
+    // Two full passes guarantee one started after this call
+    uint64_t target = atomic_load_explicit(&logger.passes, memory_order_acquire) + 2;
+    while (atomic_load_explicit(&logger.passes, memory_order_acquire) < target) {
+        struct timespec idle = { 0, LOG_IDLE_SLEEP_NS };
+        nanosleep(&idle, NULL);
+    }
+}
+
+// Write all pending records and stop the writer thread
+void log_shutdown() {
+    if (!logger.running) {
+        return;
+    }
+
+    atomic_store_explicit(&logger.stop, true, memory_order_release);
+    CHECK_PTHREAD_RETURN(pthread_join(logger.writer, NULL), "Logger: writer thread join");
+    logger.running = false;
+
+    for (LogRing* ring = logger.rings; ring != NULL;) {
+        LogRing* next = ring->next;
+        free(ring);
+        ring = next;
+    }
+    logger.rings = NULL;
+    logger.free_rings = NULL;
+    CHECK_PTHREAD_RETURN(pthread_key_delete(logger.ring_key), "Logger: key deletion");
+}
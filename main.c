@@ -1,795 +1,204 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
-#include <stdarg.h>
-#include <unistd.h>
 #include <stdbool.h>
-#include <time.h>
 #include <errno.h>
 #include <string.h>
 
-// Compilation flags
-// Uncomment to enable debug prints
-// #define DEBUG_PRINT
+#include "zso.h"
 
-// Uncomment to enable debug delays
-// #define DEBUG_SLEEP
-
-// Error checking macro for pthread functions
-#define CHECK_PTHREAD_RETURN(x, msg) \
-    do { \
-        int ret = (x); \
-        if (ret != 0) { \
-            fprintf(stderr, "%s failed: %s\n", msg, strerror(ret)); \
-            exit(EXIT_FAILURE); \
-        } \
-    } while(0)
-
-// Constants (parameterizable at compilation level)
-#define NUM_CLASSES 5
-#define STUDENTS_PER_CLASS 20
-#define TOTAL_STUDENTS (NUM_CLASSES * STUDENTS_PER_CLASS)
-#define MIN_STUDENTS_FOR_LESSON 10
-#define NUM_TEACHERS NUM_CLASSES
-#define REQUIRED_LESSONS 3
-#define LESSON_DURATION 3  // in seconds, only used when DEBUG_SLEEP is defined
-#define WAIT_TIMEOUT_SEC 0.1 // Timeout for condition variable waits
-
-// Logging levels
-#define LOG_INFO    0
-#define LOG_DEBUG   1
-#define LOG_VERBOSE 2
-#define CURRENT_LOG_LEVEL LOG_INFO
-
-// Classroom/Lesson states
-#define LESSON_WAITING 0
-#define LESSON_IN_PROGRESS 1
-#define LESSON_ENDED 2
-
-// Structure for classroom data
+// Work shared by the parallel runners
 typedef struct {
-    int id;
-    int state;
-    int teacher_id;
-    int students_count;
-    int students_inside[TOTAL_STUDENTS]; // To track which students are in the classroom
-    pthread_mutex_t mutex;
-    pthread_cond_t lesson_start_cv;
-    pthread_cond_t lesson_end_cv;
-} Classroom;
-
-// Global variables
-Classroom classrooms[NUM_CLASSES];
-int students_in_school = TOTAL_STUDENTS;
-int remaining_teachers = NUM_TEACHERS;
-pthread_mutex_t school_mutex;
-
-// Add a school-wide condition variable to signal state changes
-pthread_cond_t school_cond;
-
-// Student and teacher tracking
-int student_lessons_attended[TOTAL_STUDENTS] = {0};
-int teacher_lessons_taught[NUM_TEACHERS] = {0};
-int student_lesson_history[TOTAL_STUDENTS][REQUIRED_LESSONS] = {{-1}};
-int teacher_lesson_history[NUM_TEACHERS][REQUIRED_LESSONS] = {{-1}};
-
-// Helper function to print debug messages with log levels
-void log_message(int level, const char* format, ...) {
-#ifdef DEBUG_PRINT
-    if (level <= CURRENT_LOG_LEVEL) {
-        va_list args;
-        va_start(args, format);
-
-        // Lock for printf to ensure atomic console output
-        static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
-        pthread_mutex_lock(&log_mutex);
-
-        // Print the actual message
-        vprintf(format, args);
-
-        pthread_mutex_unlock(&log_mutex);
-        va_end(args);
-    }
-#endif
-}
-
-// Helper function to introduce delays
-void debug_sleep(int seconds) {
-#ifdef DEBUG_SLEEP
-    sleep(seconds);
-#endif
-}
-
-// Helper function to check if a student has already attended a classroom
-bool student_already_attended_classroom(int student_id, int classroom_id, int lessons_attended) {
-    // IMPORTANT: This function assumes the caller already holds the school_mutex
-    for (int i = 0; i < lessons_attended; i++) {
-        if (student_lesson_history[student_id][i] == classroom_id) {
-            return true;
-        }
-    }
-    return false;
-}
-
-// Initialize the classrooms
-void initialize_classrooms() {
-    for (int i = 0; i < NUM_CLASSES; i++) {
-        classrooms[i].id = i;
-        classrooms[i].state = LESSON_WAITING;
-        classrooms[i].teacher_id = -1;
-        classrooms[i].students_count = 0;
-
-        for (int j = 0; j < TOTAL_STUDENTS; j++) {
-            classrooms[i].students_inside[j] = 0;
-        }
-
-        CHECK_PTHREAD_RETURN(pthread_mutex_init(&classrooms[i].mutex, NULL),
-                            "Classroom mutex initialization");
-        CHECK_PTHREAD_RETURN(pthread_cond_init(&classrooms[i].lesson_start_cv, NULL),
-                            "Classroom start condition initialization");
-        CHECK_PTHREAD_RETURN(pthread_cond_init(&classrooms[i].lesson_end_cv, NULL),
-                            "Classroom end condition initialization");
-    }
-
-    CHECK_PTHREAD_RETURN(pthread_mutex_init(&school_mutex, NULL),
-                        "School mutex initialization");
-    CHECK_PTHREAD_RETURN(pthread_cond_init(&school_cond, NULL),
-                        "School condition variable initialization");
+    pthread_mutex_t mutex;  // Protects next_run, stopped, batch and stdout
+    int next_run;
+    bool stopped;           // Batch converged, no new runs are claimed
+    Batch* batch;
+} RunQueue;
+
+// Print command line help
+void print_usage(const char* program) {
+    printf("Usage: %s [options]\n"
+           "  --config=FILE              read options from FILE (one key = value per line)\n"
+           "  --classes=N                number of classrooms and teachers (default %d)\n"
+           "  --students-per-class=N     students per classroom (default %d)\n"
+           "  --min-students=N           students required to start a lesson (default %d)\n"
+           "  --lessons=N                lessons each agent must complete (default %d)\n"
+           "  --timeout=SEC              condition variable wait timeout (default %.1f)\n"
+           "  --wait-policy=fixed|backoff  idle students wait a fixed timeout or back off\n"
+           "                             exponentially up to %dx the timeout (default fixed)\n"
+           "  --lesson-duration=SEC      simulated length of a lesson (default %.1f)\n"
+           "  --time-scale=S             threads and coroutines engines: real seconds per simulated\n"
+           "                             second, 0 for virtual time as fast as possible (default %.1f)\n"
+           "  --runs=N                   number of simulation runs (default %d)\n"
+           "  --parallel-runs=K          independent runs simulated concurrently (default %d)\n"
+           "  --report=runs|summary      print every run, or only the batch summary (default runs)\n"
+           "  --confidence=P             confidence level of the batch intervals (default %.2f)\n"
+           "  --ci-width=W               stop after at least %d runs once both completion-rate\n"
+           "                             intervals are within +/- W percentage points (default off)\n"
+           "  --engine=threads|des|deterministic|coroutines\n"
+           "                             thread-per-agent, discrete-event, thread-per-agent\n"
+           "                             interleaved by a seeded scheduler, or agents as\n"
+           "                             coroutines on a worker pool (default threads)\n"
+           "  --seed=N                   scheduler seed for the deterministic engine (default %d)\n"
+           "  --workers=N                worker threads of the coroutine engine (default: CPUs)\n"
+           "  --lock-stats=on|off        report mutex contention after each run's statistics\n"
+           "  --wake-stats=on|off        thread engines: report how many agents each signal site\n"
+           "                             woke and how many of them made progress\n"
+           "  --trace=FILE               thread engines: write each run's timeline as a Chrome trace\n"
+           "                             (Perfetto); with several runs FILE gets the run number\n"
+           "  --event-log=FILE           write a compact binary log of every run's events to FILE,\n"
+           "                             see zso_replay\n"
+           "  --matcher=on|off           thread engines: a matcher assigns waiting students to\n"
+           "                             classrooms in batches instead of students probing rooms\n"
+           "  --match-interval=SEC       time between matching rounds, 0 to match whenever\n"
+           "                             students queue up or rooms open (default %.3f)\n"
+           "  --log-level=off|info|debug|verbose  asynchronous log verbosity (default %s)\n"
+           "  --help                     show this message\n"
+           "Config file keys are the option names without the leading dashes.\n",
+           program, DEFAULT_NUM_CLASSES, DEFAULT_STUDENTS_PER_CLASS,
+           DEFAULT_MIN_STUDENTS_FOR_LESSON, DEFAULT_REQUIRED_LESSONS,
+           DEFAULT_WAIT_TIMEOUT_SEC, WAIT_BACKOFF_MAX_FACTOR, DEFAULT_LESSON_DURATION_SEC,
+           DEFAULT_TIME_SCALE, DEFAULT_NUM_RUNS,
+           DEFAULT_PARALLEL_RUNS, DEFAULT_CONFIDENCE, BATCH_MIN_RUNS, DEFAULT_SEED,
+           DEFAULT_MATCH_INTERVAL_SEC, DEFAULT_LOG_LEVEL == LOG_OFF ? "off" : "info");
 }
 
-// Clean up resources
-void cleanup_resources() {
-    for (int i = 0; i < NUM_CLASSES; i++) {
-        // FIX: Destroy condition variables before mutexes
-        CHECK_PTHREAD_RETURN(pthread_cond_destroy(&classrooms[i].lesson_start_cv),
-                            "Classroom start condition destruction");
-        CHECK_PTHREAD_RETURN(pthread_cond_destroy(&classrooms[i].lesson_end_cv),
-                            "Classroom end condition destruction");
-        CHECK_PTHREAD_RETURN(pthread_mutex_destroy(&classrooms[i].mutex),
-                            "Classroom mutex destruction");
-    }
-
-    // FIX: Destroy condition variable before mutex
-    CHECK_PTHREAD_RETURN(pthread_cond_destroy(&school_cond),
-                        "School condition variable destruction");
-    CHECK_PTHREAD_RETURN(pthread_mutex_destroy(&school_mutex),
-                        "School mutex destruction");
+// Print one run's statistics between the run banners
+void print_run_report(Simulation* sim, FILE* out) {
+    fprintf(out, "\n===== Starting simulation run %d =====\n", sim->run_id + 1);
+    generate_simulation_stats(sim, out);
+    print_counter_report(sim, out);
+    print_lock_report(sim, out);
+    print_wake_report(sim, out);
+    fprintf(out, "\n===== Completed simulation run %d =====\n\n", sim->run_id + 1);
 }
 
-// Check if there are enough students left in school for a regular lesson
-// Caller MUST hold school_mutex before calling this function
-bool enough_students_for_regular_lesson() {
-    return students_in_school >= MIN_STUDENTS_FOR_LESSON;
-}
-
-// Helper to get students in school safely
-int get_students_in_school() {
-    int count;
-    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&school_mutex),
-                        "get_students_in_school: lock");
-    count = students_in_school;
-    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&school_mutex),
-                        "get_students_in_school: unlock");
-    return count;
-}
-
-// Teacher thread function
-void* teacher_function(void* arg) {
-    int teacher_id = *((int*)arg);
-    free(arg);
-
-    log_message(LOG_INFO, "Teacher %d has arrived at school.\n", teacher_id);
-
-    int classroom_id = teacher_id; // Each teacher has a designated classroom
-    int lessons_taught = 0;
-    int consecutive_timeouts = 0; // Track consecutive timeouts
-
-    while (lessons_taught < REQUIRED_LESSONS) {
-        log_message(LOG_INFO, "Teacher %d preparing for lesson %d in classroom %d.\n",
-                   teacher_id, lessons_taught + 1, classroom_id);
-
-        // First check if we should start with fewer students
-        bool start_with_fewer = false;
-
-        CHECK_PTHREAD_RETURN(pthread_mutex_lock(&school_mutex),
-                            "Teacher: school mutex lock");
-
-        // Check and update school state
-        start_with_fewer = (students_in_school < MIN_STUDENTS_FOR_LESSON);
-
-        // Signal any waiting students that a teacher is about to start a lesson
-        pthread_cond_broadcast(&school_cond);
-
-        CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&school_mutex),
-                            "Teacher: school mutex unlock");
-
-        CHECK_PTHREAD_RETURN(pthread_mutex_lock(&classrooms[classroom_id].mutex),
-                            "Teacher: classroom mutex lock");
-
-        // Mark this classroom as having a teacher
-        classrooms[classroom_id].teacher_id = teacher_id;
-        classrooms[classroom_id].state = LESSON_WAITING;
-
-        if (!start_with_fewer) {
-            // Regular case: wait for enough students
-            int wait_count = 0;
-            int max_waits = 3; // Maximum number of timeout waits before checking conditions
-
-            while (classrooms[classroom_id].students_count < MIN_STUDENTS_FOR_LESSON) {
-                // Before waiting, check again if we should start with fewer
-                CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&classrooms[classroom_id].mutex),
-                                   "Teacher: temporary classroom mutex unlock for school check");
+// Run the simulations one after another on a single context
+void run_sequential(Batch* batch) {
+    Simulation* sim = simulation_create(&config);
 
-                CHECK_PTHREAD_RETURN(pthread_mutex_lock(&school_mutex),
-                                   "Teacher: school mutex lock in wait loop");
+    for (int run = 0; run < config.num_runs; run++) {
+        sim->run_id = run;
+        project_zso(sim);
 
-                start_with_fewer = (students_in_school < MIN_STUDENTS_FOR_LESSON);
+        // Make sure this run's log lines come before its statistics
+        log_flush();
 
-                // Check if there are enough students left in school who haven't attended this teacher's class
-                int available_students = 0;
-                for (int i = 0; i < TOTAL_STUDENTS; i++) {
-                    // For each student in school, check if they're still around and haven't attended this class
-                    if (student_lessons_attended[i] < REQUIRED_LESSONS &&
-                        !student_already_attended_classroom(i, classroom_id, student_lessons_attended[i])) {
-                        available_students++;
-                    }
-                }
-
-                // If not enough eligible students remain for this class, start with fewer
-                if (available_students < MIN_STUDENTS_FOR_LESSON) {
-                    log_message(LOG_INFO, "Teacher %d detected only %d eligible students remain for classroom %d.\n",
-                              teacher_id, available_students, classroom_id);
-                    start_with_fewer = true;
-                }
-
-                // FIX: Always broadcast to waiting students while holding the mutex
-                pthread_cond_broadcast(&school_cond);
-
-                CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&school_mutex),
-                                   "Teacher: school mutex unlock in wait loop");
-
-                CHECK_PTHREAD_RETURN(pthread_mutex_lock(&classrooms[classroom_id].mutex),
-                                   "Teacher: re-acquire classroom mutex in wait loop");
-
-                if (start_with_fewer || wait_count >= max_waits) {
-                    // Start with fewer students after max timeouts or if conditions changed
-                    if (wait_count >= max_waits) {
-                        log_message(LOG_INFO, "Teacher %d timed out %d times waiting for students. Starting with %d students.\n",
-                                  teacher_id, wait_count, classrooms[classroom_id].students_count);
-                    }
-                    break;
-                }
-
-                log_message(LOG_DEBUG, "Teacher %d waiting for students. Current count: %d\n",
-                           teacher_id, classrooms[classroom_id].students_count);
-
-                // Use a timed wait to prevent indefinite waiting
-                struct timespec ts;
-                clock_gettime(CLOCK_REALTIME, &ts);
-                ts.tv_sec += WAIT_TIMEOUT_SEC;
-
-                int wait_result = pthread_cond_timedwait(&classrooms[classroom_id].lesson_start_cv,
-                                                      &classrooms[classroom_id].mutex,
-                                                      &ts);
-
-                if (wait_result == ETIMEDOUT) {
-                    wait_count++;
-                    consecutive_timeouts++;
-
-                    log_message(LOG_DEBUG, "Teacher %d timed out waiting for students (timeout #%d).\n",
-                              teacher_id, consecutive_timeouts);
-
-                    // After several consecutive timeouts, broadcast to students
-                    if (consecutive_timeouts >= 2) {
-                        // Temporarily release classroom lock to avoid deadlock
-                        CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&classrooms[classroom_id].mutex),
-                                           "Teacher: temporary classroom mutex unlock");
-
-                        // Get school mutex to broadcast to students
-                        CHECK_PTHREAD_RETURN(pthread_mutex_lock(&school_mutex),
-                                           "Teacher: school mutex lock for broadcast");
-
-                        log_message(LOG_DEBUG, "Teacher %d broadcasting availability after timeouts.\n", teacher_id);
-                        pthread_cond_broadcast(&school_cond);
-
-                        CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&school_mutex),
-                                           "Teacher: school mutex unlock after broadcast");
-
-                        // Re-acquire classroom lock
-                        CHECK_PTHREAD_RETURN(pthread_mutex_lock(&classrooms[classroom_id].mutex),
-                                           "Teacher: classroom mutex re-lock");
-                    }
-                } else if (wait_result != 0) {
-                    fprintf(stderr, "Teacher: waiting for students failed: %s\n",
-                            strerror(wait_result));
-                    exit(EXIT_FAILURE);
-                } else {
-                    // Successfully woke up because a student joined
-                    consecutive_timeouts = 0;
-                }
-
-                // We woke up - check if conditions have changed
-                // Signal other waiting students/teachers
-                CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&classrooms[classroom_id].mutex),
-                                   "Teacher: temporary classroom mutex unlock after wait");
-
-                CHECK_PTHREAD_RETURN(pthread_mutex_lock(&school_mutex),
-                                   "Teacher: school mutex lock after wait");
-
-                pthread_cond_broadcast(&school_cond);
-
-                CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&school_mutex),
-                                   "Teacher: school mutex unlock after wait");
-
-                CHECK_PTHREAD_RETURN(pthread_mutex_lock(&classrooms[classroom_id].mutex),
-                                   "Teacher: re-acquire classroom mutex after wait");
-            }
+        if (config.report == REPORT_RUNS) {
+            print_run_report(sim, stdout);
         }
 
-        // Reset timeout counter since we're starting a lesson
-        consecutive_timeouts = 0;
-
-        // Start the lesson
-        classrooms[classroom_id].state = LESSON_IN_PROGRESS;
-        log_message(LOG_INFO, "Teacher %d starting lesson in classroom %d with %d students%s.\n",
-                   teacher_id, classroom_id, classrooms[classroom_id].students_count,
-                   start_with_fewer ? " (fewer than required)" : "");
-
-        // Signal all students that the lesson has started
-        CHECK_PTHREAD_RETURN(pthread_cond_broadcast(&classrooms[classroom_id].lesson_start_cv),
-                            "Teacher: broadcasting lesson start");
-
-        CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&classrooms[classroom_id].mutex),
-                            "Teacher: classroom mutex unlock after starting");
-
-        // Conduct the lesson
-        debug_sleep(LESSON_DURATION);
-
-        // End the lesson
-        CHECK_PTHREAD_RETURN(pthread_mutex_lock(&classrooms[classroom_id].mutex),
-                            "Teacher: classroom mutex lock for ending");
-
-        classrooms[classroom_id].state = LESSON_ENDED;
-        log_message(LOG_INFO, "Teacher %d ending lesson in classroom %d.\n",
-                   teacher_id, classroom_id);
-
-        // Signal all students that the lesson has ended
-        CHECK_PTHREAD_RETURN(pthread_cond_broadcast(&classrooms[classroom_id].lesson_end_cv),
-                            "Teacher: broadcasting lesson end");
-
-        CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&classrooms[classroom_id].mutex),
-                            "Teacher: classroom mutex unlock after ending");
-
-        // Update teacher lessons taught with school mutex
-        CHECK_PTHREAD_RETURN(pthread_mutex_lock(&school_mutex),
-                            "Teacher: school mutex lock for history update");
-
-        // Record this lesson
-        teacher_lesson_history[teacher_id][lessons_taught] = classroom_id;
-        lessons_taught++;
-        teacher_lessons_taught[teacher_id] = lessons_taught;
-
-        CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&school_mutex),
-                            "Teacher: school mutex unlock after history update");
-
-        // Reset the classroom for the next lesson
-        CHECK_PTHREAD_RETURN(pthread_mutex_lock(&classrooms[classroom_id].mutex),
-                            "Teacher: classroom mutex lock for reset");
-
-        classrooms[classroom_id].students_count = 0;
-        for (int i = 0; i < TOTAL_STUDENTS; i++) {
-            classrooms[classroom_id].students_inside[i] = 0;
+        batch_add_run(batch, sim);
+        if (batch_converged(batch, config.confidence, config.ci_half_width)) {
+            break;
         }
-        classrooms[classroom_id].teacher_id = -1;
-
-        CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&classrooms[classroom_id].mutex),
-                            "Teacher: classroom mutex unlock after reset");
-
-        // Notify waiting students that a classroom is available
-        CHECK_PTHREAD_RETURN(pthread_mutex_lock(&school_mutex),
-                           "Teacher: school mutex lock after reset");
-
-        pthread_cond_broadcast(&school_cond);
-
-        CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&school_mutex),
-                           "Teacher: school mutex unlock after reset");
     }
 
-    // Teacher has taught required number of lessons
-    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&school_mutex),
-                        "Teacher: school mutex lock for exit");
-
-    remaining_teachers--;
-    log_message(LOG_INFO, "Teacher %d has completed all required lessons and is leaving. Teachers remaining: %d\n",
-               teacher_id, remaining_teachers);
-
-    // Signal any waiting students that teacher count has changed
-    pthread_cond_broadcast(&school_cond);
-
-    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&school_mutex),
-                        "Teacher: school mutex unlock after exit");
-
-    return NULL;
+    simulation_destroy(sim);
 }
 
-// Student thread function
-void* student_function(void* arg) {
-    int student_id = *((int*)arg);
-    free(arg);
-
-    log_message(LOG_INFO, "Student %d has arrived at school.\n", student_id);
+// Parallel runner: claims run numbers until none are left or the batch has
+// converged. Each run's report is buffered and printed in one piece so
+// concurrent runs do not interleave.
+void* runner_function(void* arg) {
+    RunQueue* queue = arg;
+    Simulation* sim = simulation_create(&config);
 
-    int lessons_attended = 0;
+    for (;;) {
+        CHECK_PTHREAD_RETURN(pthread_mutex_lock(&queue->mutex), "Runner: queue lock");
+        int run = !queue->stopped && queue->next_run < config.num_runs ? queue->next_run++ : -1;
+        CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&queue->mutex), "Runner: queue unlock");
 
-    while (lessons_attended < REQUIRED_LESSONS) {
-        // Check if any teachers are left in the school
-        CHECK_PTHREAD_RETURN(pthread_mutex_lock(&school_mutex),
-                            "Student: school mutex lock");
-
-        if (remaining_teachers == 0) {
-            // No teachers left, student should leave
-            students_in_school--;
-            log_message(LOG_INFO, "Student %d is leaving because no teachers remain. Lessons attended: %d/%d\n",
-                      student_id, lessons_attended, REQUIRED_LESSONS);
-
-            // Signal teachers about student count change
-            pthread_cond_broadcast(&school_cond);
-
-            CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&school_mutex),
-                                "Student: school mutex unlock (no teachers)");
-            return NULL;
-        }
-
-        CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&school_mutex),
-                            "Student: school mutex unlock");
-
-        bool found_classroom = false;
-        int chosen_classroom = -1;
-
-        // Look for an available classroom in sequential order
-        for (int offset = 0; offset < NUM_CLASSES && !found_classroom; offset++) {
-            int i = (student_id + offset) % NUM_CLASSES;
-
-            // First get school mutex to check attendance history
-            CHECK_PTHREAD_RETURN(pthread_mutex_lock(&school_mutex),
-                                "Student: school mutex lock for history check");
-
-            // Check if we've already attended this classroom in the past
-            bool already_attended = student_already_attended_classroom(student_id, i, lessons_attended);
-
-            CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&school_mutex),
-                                "Student: school mutex unlock after history check");
-
-            if (already_attended) {
-                continue; // Skip this classroom if already attended
-            }
-
-            CHECK_PTHREAD_RETURN(pthread_mutex_lock(&classrooms[i].mutex),
-                                "Student: classroom mutex lock");
-
-            if (classrooms[i].state == LESSON_WAITING &&
-                classrooms[i].teacher_id != -1 &&
-                !classrooms[i].students_inside[student_id]) {
-
-                // Join this classroom
-                classrooms[i].students_count++;
-                classrooms[i].students_inside[student_id] = 1;
-                chosen_classroom = i;
-                found_classroom = true;
-
-                log_message(LOG_INFO, "Student %d joined classroom %d. Student count: %d\n",
-                           student_id, i, classrooms[i].students_count);
-
-                // Signal teacher if enough students have arrived
-                // IMPORTANT: We're already holding the classroom mutex here, so this is safe
-                if (classrooms[i].students_count >= MIN_STUDENTS_FOR_LESSON) {
-                    CHECK_PTHREAD_RETURN(pthread_cond_signal(&classrooms[i].lesson_start_cv),
-                                        "Student: signaling lesson start");
-                }
-            }
-
-            CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&classrooms[i].mutex),
-                                "Student: classroom mutex unlock");
+        if (run < 0) {
+            break;
         }
 
-        if (!found_classroom) {
-            // If we couldn't find a classroom, we need to wait for a change
-            // Get the school mutex to check and update global state
-            CHECK_PTHREAD_RETURN(pthread_mutex_lock(&school_mutex),
-                                "Student: school mutex lock for wait");
-
-            // CRITICAL FIX: Check for remaining teachers again before waiting
-            if (remaining_teachers == 0) {
-                // No teachers left, student should leave
-                students_in_school--;
-                log_message(LOG_INFO, "Student %d is leaving because no teachers remain. Lessons attended: %d/%d\n",
-                          student_id, lessons_attended, REQUIRED_LESSONS);
-
-                // Signal teachers about student count change
-                pthread_cond_broadcast(&school_cond);
-
-                CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&school_mutex),
-                                    "Student: school mutex unlock (no teachers)");
-                return NULL;
-            }
-
-            // Use a timed wait instead of indefinite wait to prevent deadlock
-            struct timespec ts;
-            clock_gettime(CLOCK_REALTIME, &ts);
-            ts.tv_sec += WAIT_TIMEOUT_SEC;
-
-            // Instead of using the macro, handle the return value explicitly
-            int wait_result = pthread_cond_timedwait(&school_cond, &school_mutex, &ts);
+        sim->run_id = run;
+        project_zso(sim);
 
-            // Only treat non-timeout errors as fatal
-            if (wait_result != 0 && wait_result != ETIMEDOUT) {
-                fprintf(stderr, "Student wait error: %s\n", strerror(wait_result));
+        char* report = NULL;
+        size_t report_size = 0;
+        if (config.report == REPORT_RUNS) {
+            FILE* out = open_memstream(&report, &report_size);
+            if (out == NULL) {
+                fprintf(stderr, "Failed to open report buffer: %s\n", strerror(errno));
                 exit(EXIT_FAILURE);
             }
-
-            // FIX: After wait, recheck conditions before continuing
-            if (remaining_teachers == 0) {
-                // No teachers left, student should leave
-                students_in_school--;
-                log_message(LOG_INFO, "Student %d is leaving because no teachers remain. Lessons attended: %d/%d\n",
-                          student_id, lessons_attended, REQUIRED_LESSONS);
-
-                // Signal teachers about student count change
-                pthread_cond_broadcast(&school_cond);
-
-                CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&school_mutex),
-                                    "Student: school mutex unlock (no teachers)");
-                return NULL;
-            }
-
-            CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&school_mutex),
-                                "Student: school mutex unlock after wait");
-            continue;
+            print_run_report(sim, out);
+            fclose(out);
         }
 
-        // Wait for the lesson to start and end
-        CHECK_PTHREAD_RETURN(pthread_mutex_lock(&classrooms[chosen_classroom].mutex),
-                            "Student: classroom mutex lock (waiting for lesson)");
-
-        // Wait if the lesson hasn't started yet
-        while (classrooms[chosen_classroom].state == LESSON_WAITING) {
-            // Use a timed wait to prevent indefinite blocking
-            struct timespec ts;
-            clock_gettime(CLOCK_REALTIME, &ts);
-            ts.tv_sec += WAIT_TIMEOUT_SEC;
-
-            int wait_result = pthread_cond_timedwait(
-                &classrooms[chosen_classroom].lesson_start_cv,
-                &classrooms[chosen_classroom].mutex,
-                &ts);
-
-            // Only treat non-timeout errors as fatal
-            if (wait_result != 0 && wait_result != ETIMEDOUT) {
-                fprintf(stderr, "Student lesson start wait error: %s\n", strerror(wait_result));
-                exit(EXIT_FAILURE);
-            }
-
-            // FIX: Recheck conditions every time after wake up
-            if (classrooms[chosen_classroom].state != LESSON_WAITING) {
-                break;
-            }
-
-            // FIX: Check if the teacher is still assigned to this classroom
-            if (classrooms[chosen_classroom].teacher_id == -1) {
-                // Teacher left or reset the classroom, student should leave too
-                classrooms[chosen_classroom].students_count--;
-                classrooms[chosen_classroom].students_inside[student_id] = 0;
-
-                CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&classrooms[chosen_classroom].mutex),
-                               "Student: classroom mutex unlock (teacher left)");
-
-                // FIX: Continue outer loop instead of breaking inner loop
-                continue;
-            }
+        CHECK_PTHREAD_RETURN(pthread_mutex_lock(&queue->mutex), "Runner: result lock");
+        if (report != NULL) {
+            fwrite(report, 1, report_size, stdout);
+            fflush(stdout);
         }
 
-        // Participate in the lesson
-        log_message(LOG_DEBUG, "Student %d participating in lesson in classroom %d.\n",
-                   student_id, chosen_classroom);
-
-        // Wait for the lesson to end
-        while (classrooms[chosen_classroom].state == LESSON_IN_PROGRESS) {
-            // Use a timed wait to prevent indefinite blocking
-            struct timespec ts;
-            clock_gettime(CLOCK_REALTIME, &ts);
-            ts.tv_sec += WAIT_TIMEOUT_SEC;
-
-            int wait_result = pthread_cond_timedwait(
-                &classrooms[chosen_classroom].lesson_end_cv,
-                &classrooms[chosen_classroom].mutex,
-                &ts);
-
-            // Only treat non-timeout errors as fatal
-            if (wait_result != 0 && wait_result != ETIMEDOUT) {
-                fprintf(stderr, "Student lesson end wait error: %s\n", strerror(wait_result));
-                exit(EXIT_FAILURE);
-            }
-
-            // FIX: After timeout, check if lesson state has changed
-            if (classrooms[chosen_classroom].state != LESSON_IN_PROGRESS) {
-                break;
-            }
+        // Runs already in flight when the batch converges still count
+        batch_add_run(queue->batch, sim);
+        if (batch_converged(queue->batch, config.confidence, config.ci_half_width)) {
+            queue->stopped = true;
         }
-
-        // Lesson has ended, store the classroom ID temporarily
-        int completed_classroom = chosen_classroom;
-
-        // Release classroom mutex before getting school mutex to maintain proper locking order
-        CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&classrooms[chosen_classroom].mutex),
-                            "Student: classroom mutex unlock (lesson complete)");
-
-        // Get school mutex to update attendance information
-        CHECK_PTHREAD_RETURN(pthread_mutex_lock(&school_mutex),
-                            "Student: school mutex lock for attendance update");
-
-        // Record this lesson
-        student_lesson_history[student_id][lessons_attended] = completed_classroom;
-        lessons_attended++;
-        student_lessons_attended[student_id] = lessons_attended;
-
-        log_message(LOG_INFO, "Student %d completed lesson in classroom %d. Lessons attended: %d/%d\n",
-                   student_id, completed_classroom, lessons_attended, REQUIRED_LESSONS);
-
-        CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&school_mutex),
-                            "Student: school mutex unlock (attendance update)");
+        CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&queue->mutex), "Runner: result unlock");
+        free(report);
     }
 
-    // Student has attended required number of lessons
-    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&school_mutex),
-                        "Student: school mutex lock (exit)");
-
-    students_in_school--;
-    log_message(LOG_INFO, "Student %d has completed all required lessons and is leaving. Students remaining: %d\n",
-               student_id, students_in_school);
-
-    // Signal about student count change
-    pthread_cond_broadcast(&school_cond);
-
-    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&school_mutex),
-                        "Student: school mutex unlock (exit)");
-
+    simulation_destroy(sim);
     return NULL;
 }
 
-// Generate simulation statistics
-void generate_simulation_stats() {
-    // Count completed lessons
-    int students_completed = 0;
-    int teachers_completed = 0;
+// Run the simulations on config.parallel_runs concurrent contexts
+void run_parallel(Batch* batch) {
+    int runner_count = config.parallel_runs < config.num_runs ? config.parallel_runs : config.num_runs;
 
-    for (int i = 0; i < TOTAL_STUDENTS; i++) {
-        if (student_lessons_attended[i] == REQUIRED_LESSONS) {
-            students_completed++;
-        }
-    }
+    RunQueue queue = { .next_run = 0, .stopped = false, .batch = batch };
+    CHECK_PTHREAD_RETURN(pthread_mutex_init(&queue.mutex, NULL), "Run queue mutex initialization");
 
-    for (int i = 0; i < NUM_TEACHERS; i++) {
-        if (teacher_lessons_taught[i] == REQUIRED_LESSONS) {
-            teachers_completed++;
-        }
-    }
-
-    // Print detailed summary
-    printf("\n===== Simulation Summary =====\n");
-    printf("Students who completed all lessons: %d/%d (%.1f%%)\n",
-           students_completed, TOTAL_STUDENTS,
-           (float)students_completed/TOTAL_STUDENTS * 100);
-    printf("Teachers who completed all lessons: %d/%d (%.1f%%)\n",
-           teachers_completed, NUM_TEACHERS,
-           (float)teachers_completed/NUM_TEACHERS * 100);
+    pthread_t* threads = checked_calloc((size_t)runner_count, sizeof(pthread_t), "runner threads");
 
-    // Print details about lessons per student
-    printf("\nLesson attendance distribution:\n");
-    int attendance_count[REQUIRED_LESSONS + 1] = {0}; // Count for 0, 1, 2, 3 lessons
-    for (int i = 0; i < TOTAL_STUDENTS; i++) {
-        attendance_count[student_lessons_attended[i]]++;
+    for (int i = 0; i < runner_count; i++) {
+        CHECK_PTHREAD_RETURN(pthread_create(&threads[i], NULL, runner_function, &queue),
+                            "Runner thread creation");
     }
 
-    for (int i = 0; i <= REQUIRED_LESSONS; i++) {
-        printf("  Students who attended %d lessons: %d\n", i, attendance_count[i]);
+    for (int i = 0; i < runner_count; i++) {
+        CHECK_PTHREAD_RETURN(pthread_join(threads[i], NULL), "Runner thread join");
     }
 
-    // Print classroom utilization
-    printf("\nClassroom utilization:\n");
-    int classroom_attendance[NUM_CLASSES] = {0};
-
-    for (int i = 0; i < TOTAL_STUDENTS; i++) {
-        for (int j = 0; j < student_lessons_attended[i]; j++) {
-            if (student_lesson_history[i][j] >= 0) {
-                classroom_attendance[student_lesson_history[i][j]]++;
-            }
-        }
-    }
-
-    for (int i = 0; i < NUM_CLASSES; i++) {
-        printf("  Classroom %d: %d students attended\n", i, classroom_attendance[i]);
-    }
+    free(threads);
+    CHECK_PTHREAD_RETURN(pthread_mutex_destroy(&queue.mutex), "Run queue mutex destruction");
 }
 
-// The function to run 10 times
-void project_zso() {
-    // Reset global variables for this run
-    students_in_school = TOTAL_STUDENTS;
-    remaining_teachers = NUM_TEACHERS;
-
-    // Reset tracking arrays
-    memset(student_lessons_attended, 0, sizeof(student_lessons_attended));
-    memset(teacher_lessons_taught, 0, sizeof(teacher_lessons_taught));
-
-    // Reset student and teacher lesson history
-    for (int i = 0; i < TOTAL_STUDENTS; i++) {
-        for (int j = 0; j < REQUIRED_LESSONS; j++) {
-            student_lesson_history[i][j] = -1;
-        }
+int main(int argc, char* argv[]) {
+    if (!parse_command_line(argc, argv, print_usage, NULL)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
     }
 
-    for (int i = 0; i < NUM_TEACHERS; i++) {
-        for (int j = 0; j < REQUIRED_LESSONS; j++) {
-            teacher_lesson_history[i][j] = -1;
-        }
-    }
+    log_init();
+    event_log_open();
 
-    // Initialize resources
-    initialize_classrooms();
+    Batch batch;
+    batch_init(&batch, &config);
 
-    // Create teacher threads
-    pthread_t teacher_threads[NUM_TEACHERS];
-    for (int i = 0; i < NUM_TEACHERS; i++) {
-        int* id = malloc(sizeof(int));
-        if (id == NULL) {
-            fprintf(stderr, "Failed to allocate memory for teacher ID\n");
-            exit(EXIT_FAILURE);
-        }
-
-        *id = i;
-        CHECK_PTHREAD_RETURN(pthread_create(&teacher_threads[i], NULL, teacher_function, id),
-                            "Teacher thread creation");
+    // Run the simulation up to config.num_runs times
+    if (config.parallel_runs > 1) {
+        run_parallel(&batch);
+    } else {
+        run_sequential(&batch);
     }
 
-    // Create student threads
-    pthread_t student_threads[TOTAL_STUDENTS];
-    for (int i = 0; i < TOTAL_STUDENTS; i++) {
-        int* id = malloc(sizeof(int));
-        if (id == NULL) {
-            fprintf(stderr, "Failed to allocate memory for student ID\n");
-            exit(EXIT_FAILURE);
+    if (batch.student_completion.count > 1 || config.report == REPORT_SUMMARY) {
+        batch_print(&batch, config.confidence, stdout);
+        if (batch.student_completion.count < config.num_runs) {
+            printf("\nStopped early: intervals within +/- %.2f percentage points after %lld of %d runs.\n",
+                   config.ci_half_width, batch.student_completion.count, config.num_runs);
         }
-
-        *id = i;
-        CHECK_PTHREAD_RETURN(pthread_create(&student_threads[i], NULL, student_function, id),
-                            "Student thread creation");
-    }
-
-    // Wait for all threads to finish
-    for (int i = 0; i < NUM_TEACHERS; i++) {
-        CHECK_PTHREAD_RETURN(pthread_join(teacher_threads[i], NULL),
-                            "Teacher thread join");
-    }
-
-    for (int i = 0; i < TOTAL_STUDENTS; i++) {
-        CHECK_PTHREAD_RETURN(pthread_join(student_threads[i], NULL),
-                            "Student thread join");
-    }
-
-    // Generate and print statistics
-    generate_simulation_stats();
-
-    // Clean up
-    cleanup_resources();
-}
-
-int main() {
-    // Run the simulation 10 times
-    for (int run = 0; run < 10; run++) {
-        printf("\n===== Starting simulation run %d =====\n", run + 1);
-        project_zso();
-        printf("\n===== Completed simulation run %d =====\n\n", run + 1);
     }
 
+    batch_free(&batch);
+    coro_pool_shutdown();
+    event_log_close();
+    log_shutdown();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,190 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "zso.h"
+
+// Centralized matching for the thread engines (--matcher=on).
+//
+// Students that need a classroom do not probe rooms themselves: they queue
+// in the waiting-student FIFO and sleep. A matcher agent, woken whenever the
+// queue grows or a teacher opens a room, or every --match-interval seconds,
+// assigns the whole queue greedily. Batching by interval lets students
+// returning from lessons queue up before rooms are filled, at the price of
+// up to one interval of extra waiting.
+// The first pass fills rooms up to min_students_for_lesson: open rooms are
+// ordered by how few students they still miss, so the rooms closest to their
+// quorum start first, and each waiting student, oldest first, is seated in
+// the first of them it has not attended yet. The second pass spreads the
+// students left over round-robin across every open room they may still
+// attend, since a lesson is not limited to its quorum. Students with no
+// eligible open room wait for the next round.
+
+typedef struct {
+    int id;
+    int missing;  // Seats still needed for the quorum
+    bool closed;  // The teacher closed admission during this round
+} MatchRoom;
+
+static int compare_missing(const void* a, const void* b) {
+    const MatchRoom* room_a = a;
+    const MatchRoom* room_b = b;
+    if (room_a->missing != room_b->missing) {
+        return room_a->missing - room_b->missing;
+    }
+    return room_a->id - room_b->id;
+}
+
+// Wake the matcher after students queued up or a room opened, unless it runs
+// on a fixed interval. Caller holds school_mutex.
+void matcher_notify(Simulation* sim) {
+    if (sim->config.match_interval_sec == 0 || sim->remaining_teachers == 0) {
+        SIGNAL_COND(sim, &sim->matcher_cv, false, "Matcher: notify");
+    }
+}
+
+// Open classrooms, fewest students missing first
+static int collect_open_rooms(Simulation* sim, MatchRoom* rooms) {
+    int count = 0;
+    for (size_t word = 0; word < sim->visited_words; word++) {
+        uint64_t bits = atomic_load_explicit(&sim->open_classrooms[word], memory_order_acquire);
+        while (bits != 0) {
+            int id = (int)(word * 64 + (size_t)__builtin_ctzll(bits));
+            bits &= bits - 1;
+
+            int missing = sim->config.min_students_for_lesson - classroom_seats_taken(&sim->classrooms[id]);
+            rooms[count].id = id;
+            rooms[count].missing = missing > 0 ? missing : 0;
+            rooms[count].closed = false;
+            count++;
+        }
+    }
+    qsort(rooms, (size_t)count, sizeof(MatchRoom), compare_missing);
+    return count;
+}
+
+// Seat a waiting student in room unless it attended it before or the
+// room was closed meanwhile. Adds the room to ready when it reaches its
+// quorum. Caller holds school_mutex.
+static bool seat_student(Simulation* sim, int student_id, MatchRoom* room, int* ready, int* ready_count) {
+    if (room->closed ||
+        student_already_attended_classroom(sim, student_id, room->id, sim->student_lessons_attended[student_id])) {
+        return false;
+    }
+
+    int seats = classroom_claim_seat(sim, &sim->classrooms[room->id], student_id);
+    if (seats == 0) {
+        room->closed = true;
+        return false;
+    }
+
+    remove_waiting_student(sim, student_id);
+    sim->student_waiters[student_id].assigned_classroom = room->id;
+    SIGNAL_COND(sim, &sim->student_waiters[student_id].wakeup_cv, false,
+                "Matcher: waking assigned student");
+
+    if (seats == sim->config.min_students_for_lesson) {
+        ready[(*ready_count)++] = room->id;
+    }
+    room->missing = seats < sim->config.min_students_for_lesson ? sim->config.min_students_for_lesson - seats : 0;
+    return true;
+}
+
+// One matching round over the waiting queue. Caller holds school_mutex.
+// Returns the number of rooms that reached their quorum, listed in ready.
+static int match_waiting_students(Simulation* sim, MatchRoom* rooms, int* ready) {
+    int room_count = collect_open_rooms(sim, rooms);
+    int ready_count = 0;
+
+    // Fill rooms to their quorum, closest first
+    int first_missing = 0;
+    while (first_missing < room_count && rooms[first_missing].missing == 0) {
+        first_missing++;
+    }
+    int student_id = sim->waiters_head;
+    while (student_id >= 0 && first_missing < room_count) {
+        int next = sim->student_waiters[student_id].next;
+
+        for (int r = first_missing; r < room_count; r++) {
+            if (rooms[r].missing > 0 && seat_student(sim, student_id, &rooms[r], ready, &ready_count)) {
+                break;
+            }
+        }
+        while (first_missing < room_count && (rooms[first_missing].missing == 0 || rooms[first_missing].closed)) {
+            first_missing++;
+        }
+        student_id = next;
+    }
+
+    // Spread whoever is left over all open rooms
+    int cursor = 0;
+    student_id = sim->waiters_head;
+    while (student_id >= 0 && room_count > 0) {
+        int next = sim->student_waiters[student_id].next;
+
+        for (int k = 0; k < room_count; k++) {
+            int r = (cursor + k) % room_count;
+            if (seat_student(sim, student_id, &rooms[r], ready, &ready_count)) {
+                cursor = r + 1;
+                break;
+            }
+        }
+        student_id = next;
+    }
+    return ready_count;
+}
+
+// Matcher agent body: runs rounds until the last teacher has left
+void run_matcher(Simulation* sim) {
+    MatchRoom* rooms = checked_calloc((size_t)sim->config.num_classes, sizeof(MatchRoom), "matcher rooms");
+    int* ready = checked_calloc((size_t)sim->config.num_classes, sizeof(int), "matcher ready rooms");
+
+    LOCK_MUTEX(sim, &sim->school_mutex,
+               "Matcher: school mutex lock");
+
+    while (sim->remaining_teachers > 0) {
+        int ready_count = 0;
+        if (sim->waiters_head >= 0) {
+            ready_count = match_waiting_students(sim, rooms, ready);
+        }
+
+        if (ready_count > 0) {
+            // Tell the teachers of full rooms; classroom mutexes are never taken under school_mutex
+            UNLOCK_MUTEX(sim, &sim->school_mutex,
+                         "Matcher: school mutex unlock to signal teachers");
+
+            for (int i = 0; i < ready_count; i++) {
+                LOCK_MUTEX(sim, &sim->classrooms[ready[i]].mutex,
+                           "Matcher: classroom mutex lock to signal teacher");
+
+                SIGNAL_COND(sim, &sim->classrooms[ready[i]].lesson_start_cv, false,
+                            "Matcher: signaling lesson start");
+
+                UNLOCK_MUTEX(sim, &sim->classrooms[ready[i]].mutex,
+                             "Matcher: classroom mutex unlock after signalling teacher");
+            }
+
+            LOCK_MUTEX(sim, &sim->school_mutex,
+                       "Matcher: school mutex lock after signalling teachers");
+        }
+
+        // Without an interval, progress may have enabled more matches right away
+        if (sim->config.match_interval_sec > 0) {
+            int wait_result = wait_until(sim, &sim->matcher_cv, &sim->school_mutex, sim->config.match_interval_sec,
+                                         "Matcher: waiting for the next round");
+            counter_wait_result(wait_result, sim->waiters_head >= 0 || sim->remaining_teachers == 0);
+        } else if (ready_count == 0) {
+            int wait_result = wait_until(sim, &sim->matcher_cv, &sim->school_mutex, sim->config.wait_timeout_sec,
+                                         "Matcher: waiting for students or classrooms");
+            counter_wait_result(wait_result, sim->waiters_head >= 0 || sim->remaining_teachers == 0);
+        }
+    }
+
+    UNLOCK_MUTEX(sim, &sim->school_mutex,
+                 "Matcher: school mutex unlock");
+
+    free(rooms);
+    free(ready);
+}
@@ -0,0 +1,312 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <string.h>
+
+#include "zso.h"
+
+// Runtime configuration shared by every program built from the simulation:
+// defaults, "--name=value" command line parsing and "key = value" config files.
+
+// Global variables
+SimConfig config = {
+    .num_classes = DEFAULT_NUM_CLASSES,
+    .students_per_class = DEFAULT_STUDENTS_PER_CLASS,
+    .min_students_for_lesson = DEFAULT_MIN_STUDENTS_FOR_LESSON,
+    .required_lessons = DEFAULT_REQUIRED_LESSONS,
+    .wait_timeout_sec = DEFAULT_WAIT_TIMEOUT_SEC,
+    .wait_policy = WAIT_POLICY_FIXED,
+    .lesson_duration_sec = DEFAULT_LESSON_DURATION_SEC,
+    .time_scale = DEFAULT_TIME_SCALE,
+    .num_runs = DEFAULT_NUM_RUNS,
+    .parallel_runs = DEFAULT_PARALLEL_RUNS,
+    .report = REPORT_RUNS,
+    .confidence = DEFAULT_CONFIDENCE,
+    .ci_half_width = 0,
+    .engine = ENGINE_THREADS,
+    .seed = DEFAULT_SEED,
+    .workers = 0,
+    .lock_stats = false,
+    .wake_stats = false,
+    .trace_path = NULL,
+    .event_log_path = NULL,
+    .matcher = false,
+    .match_interval_sec = DEFAULT_MATCH_INTERVAL_SEC,
+    .log_level = DEFAULT_LOG_LEVEL,
+};
+
+// Parse a strictly positive integer option value
+bool parse_positive_int(const char* value, int* out) {
+    char* end;
+    errno = 0;
+    long parsed = strtol(value, &end, 10);
+    if (errno != 0 || end == value || *end != '\0' || parsed <= 0 || parsed > 1000000000L) {
+        return false;
+    }
+    *out = (int)parsed;
+    return true;
+}
+
+// Parse a non-negative floating point option value
+bool parse_non_negative_double(const char* value, double* out) {
+    char* end;
+    errno = 0;
+    double parsed = strtod(value, &end);
+    if (errno != 0 || end == value || *end != '\0' || parsed < 0) {
+        return false;
+    }
+    *out = parsed;
+    return true;
+}
+
+// Parse an on/off switch
+bool parse_switch(const char* value, bool* out) {
+    if (strcmp(value, "on") == 0) {
+        *out = true;
+    } else if (strcmp(value, "off") == 0) {
+        *out = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Keep a path option; config file lines do not outlive parsing
+const char* copy_path(const char* value) {
+    char* path = strdup(value);
+    if (path == NULL) {
+        fprintf(stderr, "Failed to allocate memory for path '%s'\n", value);
+        exit(EXIT_FAILURE);
+    }
+    return path;
+}
+
+// Program-specific options, consulted before a name is reported as unknown
+static OptionHandler extra_option_handler = NULL;
+
+// Apply a single "name=value" setting, shared by the command line and config files
+bool apply_option(const char* name, const char* value) {
+    bool ok;
+
+    if (strcmp(name, "config") == 0) {
+        ok = load_config_file(value);
+    } else if (strcmp(name, "classes") == 0) {
+        ok = parse_positive_int(value, &config.num_classes);
+    } else if (strcmp(name, "students-per-class") == 0) {
+        ok = parse_positive_int(value, &config.students_per_class);
+    } else if (strcmp(name, "min-students") == 0) {
+        ok = parse_positive_int(value, &config.min_students_for_lesson);
+    } else if (strcmp(name, "lessons") == 0) {
+        ok = parse_positive_int(value, &config.required_lessons);
+    } else if (strcmp(name, "timeout") == 0) {
+        ok = parse_non_negative_double(value, &config.wait_timeout_sec);
+    } else if (strcmp(name, "wait-policy") == 0) {
+        ok = true;
+        if (strcmp(value, "fixed") == 0) {
+            config.wait_policy = WAIT_POLICY_FIXED;
+        } else if (strcmp(value, "backoff") == 0) {
+            config.wait_policy = WAIT_POLICY_BACKOFF;
+        } else {
+            ok = false;
+        }
+    } else if (strcmp(name, "runs") == 0) {
+        ok = parse_positive_int(value, &config.num_runs);
+    } else if (strcmp(name, "parallel-runs") == 0) {
+        ok = parse_positive_int(value, &config.parallel_runs);
+    } else if (strcmp(name, "report") == 0) {
+        ok = true;
+        if (strcmp(value, "runs") == 0) {
+            config.report = REPORT_RUNS;
+        } else if (strcmp(value, "summary") == 0) {
+            config.report = REPORT_SUMMARY;
+        } else {
+            ok = false;
+        }
+    } else if (strcmp(name, "confidence") == 0) {
+        ok = parse_non_negative_double(value, &config.confidence) &&
+             config.confidence > 0 && config.confidence < 1;
+    } else if (strcmp(name, "ci-width") == 0) {
+        ok = parse_non_negative_double(value, &config.ci_half_width);
+    } else if (strcmp(name, "seed") == 0) {
+        ok = parse_positive_int(value, &config.seed);
+    } else if (strcmp(name, "lesson-duration") == 0) {
+        ok = parse_non_negative_double(value, &config.lesson_duration_sec);
+    } else if (strcmp(name, "time-scale") == 0) {
+        ok = parse_non_negative_double(value, &config.time_scale);
+    } else if (strcmp(name, "workers") == 0) {
+        ok = parse_positive_int(value, &config.workers);
+    } else if (strcmp(name, "lock-stats") == 0) {
+        ok = parse_switch(value, &config.lock_stats);
+    } else if (strcmp(name, "wake-stats") == 0) {
+        ok = parse_switch(value, &config.wake_stats);
+    } else if (strcmp(name, "trace") == 0) {
+        ok = *value != '\0';
+        if (ok) {
+            free((void*)config.trace_path);
+            config.trace_path = copy_path(value);
+        }
+    } else if (strcmp(name, "event-log") == 0) {
+        ok = *value != '\0';
+        if (ok) {
+            free((void*)config.event_log_path);
+            config.event_log_path = copy_path(value);
+        }
+    } else if (strcmp(name, "matcher") == 0) {
+        ok = parse_switch(value, &config.matcher);
+    } else if (strcmp(name, "match-interval") == 0) {
+        ok = parse_non_negative_double(value, &config.match_interval_sec);
+    } else if (strcmp(name, "log-level") == 0) {
+        ok = true;
+        if (strcmp(value, "off") == 0) {
+            config.log_level = LOG_OFF;
+        } else if (strcmp(value, "info") == 0) {
+            config.log_level = LOG_INFO;
+        } else if (strcmp(value, "debug") == 0) {
+            config.log_level = LOG_DEBUG;
+        } else if (strcmp(value, "verbose") == 0) {
+            config.log_level = LOG_VERBOSE;
+        } else {
+            ok = false;
+        }
+    } else if (strcmp(name, "engine") == 0) {
+        ok = true;
+        if (strcmp(value, "threads") == 0) {
+            config.engine = ENGINE_THREADS;
+        } else if (strcmp(value, "des") == 0) {
+            config.engine = ENGINE_DES;
+        } else if (strcmp(value, "deterministic") == 0) {
+            config.engine = ENGINE_DETERMINISTIC;
+        } else if (strcmp(value, "coroutines") == 0) {
+            config.engine = ENGINE_COROUTINES;
+        } else {
+            ok = false;
+        }
+    } else if (extra_option_handler == NULL || !extra_option_handler(name, value, &ok)) {
+        fprintf(stderr, "Unknown option '%s'\n", name);
+        return false;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Invalid value '%s' for option '%s'\n", value, name);
+    }
+    return ok;
+}
+
+// Strip leading and trailing whitespace in place
+char* trim(char* text) {
+    while (*text == ' ' || *text == '\t') {
+        text++;
+    }
+    char* end = text + strlen(text);
+    while (end > text && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n' || end[-1] == '\r')) {
+        *--end = '\0';
+    }
+    return text;
+}
+
+// Config files may include others with "config = path"; this bounds the
+// nesting so a file that includes itself fails instead of recursing forever
+#define MAX_CONFIG_DEPTH 8
+
+static int config_depth;
+
+// Read "key = value" lines from a config file; '#' starts a comment
+bool load_config_file(const char* path) {
+    if (config_depth == MAX_CONFIG_DEPTH) {
+        fprintf(stderr, "Config files nested more than %d deep at '%s'; does one include itself?\n",
+                MAX_CONFIG_DEPTH, path);
+        return false;
+    }
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot open config file '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+    config_depth++;
+
+    char line[512];
+    int line_number = 0;
+    bool ok = true;
+
+    while (ok && fgets(line, sizeof(line), file) != NULL) {
+        line_number++;
+
+        char* comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+
+        char* key = trim(line);
+        if (*key == '\0') {
+            continue;
+        }
+
+        char* separator = strchr(key, '=');
+        if (separator == NULL) {
+            fprintf(stderr, "%s:%d: expected 'key = value'\n", path, line_number);
+            ok = false;
+            break;
+        }
+
+        *separator = '\0';
+        ok = apply_option(trim(key), trim(separator + 1));
+        if (!ok) {
+            fprintf(stderr, "%s:%d: invalid setting\n", path, line_number);
+        }
+    }
+
+    fclose(file);
+    config_depth--;
+    return ok;
+}
+
+// Parse command line options into config and derive dependent sizes.
+// usage is printed for --help; extra handles options only this program knows.
+bool parse_command_line(int argc, char* argv[], void (*usage)(const char* program), OptionHandler extra) {
+    extra_option_handler = extra;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+
+        if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        }
+
+        if (strncmp(arg, "--", 2) != 0 || strchr(arg, '=') == NULL) {
+            fprintf(stderr, "Unrecognized argument '%s' (expected --name=value)\n", arg);
+            return false;
+        }
+
+        char name[64];
+        const char* value = strchr(arg, '=') + 1;
+        size_t name_length = (size_t)(value - 1 - (arg + 2));
+        if (name_length >= sizeof(name)) {
+            fprintf(stderr, "Unknown option '%s'\n", arg);
+            return false;
+        }
+        memcpy(name, arg + 2, name_length);
+        name[name_length] = '\0';
+
+        if (!apply_option(name, value)) {
+            return false;
+        }
+    }
+
+    return derive_config_sizes(&config);
+}
+
+// Fill in the sizes that follow from the number of classes
+bool derive_config_sizes(SimConfig* sim_config) {
+    long long total = (long long)sim_config->num_classes * sim_config->students_per_class;
+    if (total > 100000000LL) {
+        fprintf(stderr, "Too many students: %lld\n", total);
+        return false;
+    }
+
+    sim_config->total_students = (int)total;
+    sim_config->num_teachers = sim_config->num_classes;
+    return true;
+}
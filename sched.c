@@ -0,0 +1,249 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zso.h"
+
+// Deterministic scheduler for the thread-per-agent engine.
+//
+// Agents still run on their own pthreads, but only the one holding the baton
+// executes; everyone else is parked in a wait or has not started yet. An
+// agent gives the baton away only where the real engine would block (a timed
+// condition wait) or when it exits, and the next agent is drawn from the
+// runnable set with a seeded generator. Timeouts are measured on a virtual
+// clock that jumps to the earliest deadline once nobody is runnable, so the
+// same seed always replays the same interleaving, independent of host load.
+//
+// Signals and waits are matched by condition variable address with a linear
+// scan over the agents, which is fine at the sizes this mode is meant for.
+
+// Agent states
+#define SCHED_RUNNABLE 0
+#define SCHED_BLOCKED 1
+#define SCHED_EXITED 2
+
+typedef struct {
+    int state;
+    pthread_cond_t* cond;         // What a blocked agent waits for
+    double deadline;              // Virtual time at which its wait times out
+    unsigned long long wait_seq;  // Signals wake the longest waiting agent first
+    bool timed_out;
+    pthread_cond_t baton;         // Signalled when the agent is chosen to run
+} SchedAgent;
+
+struct Scheduler {
+    pthread_mutex_t mutex;
+    pthread_cond_t done;     // Signalled when the last agent exits
+    SchedAgent* agents;
+    int agent_count;
+    int live_agents;
+    int* ready;              // Runnable agents in a deterministic order
+    int ready_count;
+    int current;             // Agent holding the baton, -1 for none
+    double now;
+    unsigned long long next_wait_seq;
+    uint64_t rng;
+};
+
+// Scheduler slot of the agent running on this thread
+static _Thread_local int current_agent = -1;
+
+// splitmix64: cheap, well mixed, and fully determined by its state
+static uint64_t next_random(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void sched_init(Simulation* sim, int agent_count) {
+    Scheduler* sched = checked_calloc(1, sizeof(Scheduler), "scheduler");
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_init(&sched->mutex, NULL), "Scheduler mutex initialization");
+    CHECK_PTHREAD_RETURN(pthread_cond_init(&sched->done, NULL), "Scheduler condition initialization");
+
+    sched->agents = checked_calloc((size_t)agent_count, sizeof(SchedAgent), "scheduler agents");
+    sched->ready = checked_calloc((size_t)agent_count, sizeof(int), "scheduler ready list");
+    sched->agent_count = agent_count;
+    sched->live_agents = agent_count;
+    sched->current = -1;
+
+    // Every run of a batch gets its own reproducible stream
+    uint64_t stream = (uint64_t)sim->run_id;
+    sched->rng = (uint64_t)sim->config.seed ^ next_random(&stream);
+
+    for (int i = 0; i < agent_count; i++) {
+        sched->agents[i].state = SCHED_RUNNABLE;
+        sched->ready[i] = i;
+        CHECK_PTHREAD_RETURN(pthread_cond_init(&sched->agents[i].baton, NULL),
+                            "Scheduler baton initialization");
+    }
+    sched->ready_count = agent_count;
+
+    sim->scheduler = sched;
+}
+
+void sched_destroy(Simulation* sim) {
+    Scheduler* sched = sim->scheduler;
+
+    for (int i = 0; i < sched->agent_count; i++) {
+        CHECK_PTHREAD_RETURN(pthread_cond_destroy(&sched->agents[i].baton), "Scheduler baton destruction");
+    }
+    CHECK_PTHREAD_RETURN(pthread_cond_destroy(&sched->done), "Scheduler condition destruction");
+    CHECK_PTHREAD_RETURN(pthread_mutex_destroy(&sched->mutex), "Scheduler mutex destruction");
+
+    free(sched->agents);
+    free(sched->ready);
+    free(sched);
+    sim->scheduler = NULL;
+}
+
+static void make_runnable(Scheduler* sched, int agent, bool timed_out) {
+    sched->agents[agent].state = SCHED_RUNNABLE;
+    sched->agents[agent].timed_out = timed_out;
+    sched->ready[sched->ready_count++] = agent;
+}
+
+// Hand the baton to the next agent. Caller holds sched->mutex.
+static void pass_baton(Scheduler* sched) {
+    if (sched->ready_count == 0) {
+        if (sched->live_agents == 0) {
+            sched->current = -1;
+            CHECK_PTHREAD_RETURN(pthread_cond_signal(&sched->done), "Scheduler: signalling completion");
+            return;
+        }
+
+        // Nobody can run: advance the clock to the earliest pending timeout
+        int earliest = -1;
+        for (int i = 0; i < sched->agent_count; i++) {
+            if (sched->agents[i].state == SCHED_BLOCKED &&
+                (earliest < 0 || sched->agents[i].deadline < sched->agents[earliest].deadline)) {
+                earliest = i;
+            }
+        }
+        if (earliest < 0) {
+            fprintf(stderr, "Deterministic scheduler: %d agents left but none can run\n", sched->live_agents);
+            exit(EXIT_FAILURE);
+        }
+
+        sched->now = sched->agents[earliest].deadline;
+        for (int i = 0; i < sched->agent_count; i++) {
+            if (sched->agents[i].state == SCHED_BLOCKED && sched->agents[i].deadline <= sched->now) {
+                make_runnable(sched, i, true);
+            }
+        }
+    }
+
+    int slot = (int)(next_random(&sched->rng) % (uint64_t)sched->ready_count);
+    int next = sched->ready[slot];
+    sched->ready[slot] = sched->ready[--sched->ready_count];
+
+    sched->current = next;
+    CHECK_PTHREAD_RETURN(pthread_cond_signal(&sched->agents[next].baton), "Scheduler: passing baton");
+}
+
+static void wait_for_baton(Scheduler* sched, int agent) {
+    while (sched->current != agent) {
+        CHECK_PTHREAD_RETURN(pthread_cond_wait(&sched->agents[agent].baton, &sched->mutex),
+                            "Scheduler: waiting for baton");
+    }
+}
+
+// Called first thing on an agent thread: park until the scheduler picks it
+void sched_agent_start(Simulation* sim, int agent) {
+    Scheduler* sched = sim->scheduler;
+    current_agent = agent;
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&sched->mutex), "Scheduler: lock on start");
+    wait_for_baton(sched, agent);
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&sched->mutex), "Scheduler: unlock on start");
+}
+
+// Called last thing on an agent thread
+void sched_agent_exit(Simulation* sim) {
+    Scheduler* sched = sim->scheduler;
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&sched->mutex), "Scheduler: lock on exit");
+    sched->agents[current_agent].state = SCHED_EXITED;
+    sched->live_agents--;
+    pass_baton(sched);
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&sched->mutex), "Scheduler: unlock on exit");
+
+    current_agent = -1;
+}
+
+// Release the first agent and block until every agent has exited
+void sched_run(Simulation* sim) {
+    Scheduler* sched = sim->scheduler;
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&sched->mutex), "Scheduler: lock on run");
+    pass_baton(sched);
+    while (sched->live_agents > 0) {
+        CHECK_PTHREAD_RETURN(pthread_cond_wait(&sched->done, &sched->mutex), "Scheduler: waiting for agents");
+    }
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&sched->mutex), "Scheduler: unlock on run");
+}
+
+// Deterministic counterpart of a timed condition wait: releases mutex, yields
+// the baton and re-acquires mutex once chosen again. Returns 0 or ETIMEDOUT.
+int sched_wait(Simulation* sim, pthread_cond_t* cond, pthread_mutex_t* mutex, double timeout_sec) {
+    Scheduler* sched = sim->scheduler;
+    int agent = current_agent;
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&sched->mutex), "Scheduler: lock on wait");
+
+    SchedAgent* self = &sched->agents[agent];
+    self->state = SCHED_BLOCKED;
+    self->cond = cond;
+    self->deadline = sched->now + timeout_sec;
+    self->wait_seq = sched->next_wait_seq++;
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(mutex), "Scheduler: releasing caller mutex");
+    pass_baton(sched);
+    wait_for_baton(sched, agent);
+
+    int result = self->timed_out ? ETIMEDOUT : 0;
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&sched->mutex), "Scheduler: unlock on wait");
+
+    // Uncontended: every other agent is parked without holding simulation mutexes
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(mutex), "Scheduler: re-acquiring caller mutex");
+    return result;
+}
+
+// Wake the longest waiting agent blocked on cond, or all of them
+void sched_signal(Simulation* sim, pthread_cond_t* cond, bool broadcast) {
+    Scheduler* sched = sim->scheduler;
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&sched->mutex), "Scheduler: lock on signal");
+
+    int oldest = -1;
+    for (int i = 0; i < sched->agent_count; i++) {
+        SchedAgent* agent = &sched->agents[i];
+        if (agent->state != SCHED_BLOCKED || agent->cond != cond) {
+            continue;
+        }
+        if (broadcast) {
+            make_runnable(sched, i, false);
+        } else if (oldest < 0 || agent->wait_seq < sched->agents[oldest].wait_seq) {
+            oldest = i;
+        }
+    }
+    if (oldest >= 0) {
+        make_runnable(sched, oldest, false);
+    }
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&sched->mutex), "Scheduler: unlock on signal");
+}
+
+// Virtual time of the run in seconds
+double sched_now(Simulation* sim) {
+    Scheduler* sched = sim->scheduler;
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&sched->mutex), "Scheduler: lock for time");
+    double now = sched->now;
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&sched->mutex), "Scheduler: unlock for time");
+    return now;
+}
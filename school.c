@@ -0,0 +1,453 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "zso.h"
+
+// Simulation contexts: everything one run needs lives in a Simulation, so
+// independent runs can execute concurrently. The configuration is copied in
+// and never changes while a run is active.
+
+// Per-student visited bitmaps are left NULL (falling back to scanning the
+// history) when they would exceed this, which only happens for huge class counts
+#define VISITED_BITMAP_MAX_BYTES (512ULL << 20)
+
+// Row accessors for the flattened lesson history tables
+int* student_history(Simulation* sim, int student_id) {
+    return &sim->student_lesson_history[(size_t)student_id * sim->config.required_lessons];
+}
+
+int* teacher_history(Simulation* sim, int teacher_id) {
+    return &sim->teacher_lesson_history[(size_t)teacher_id * sim->config.required_lessons];
+}
+
+// Helper function to check if a student has already attended a classroom
+bool student_already_attended_classroom(Simulation* sim, int student_id, int classroom_id, int lessons_attended) {
+    // IMPORTANT: This function assumes the caller already holds the school_mutex
+    if (sim->student_visited != NULL) {
+        uint64_t word = sim->student_visited[(size_t)student_id * sim->visited_words + (size_t)classroom_id / 64];
+        return (word >> (classroom_id % 64)) & 1;
+    }
+
+    int* history = student_history(sim, student_id);
+    for (int i = 0; i < lessons_attended; i++) {
+        if (history[i] == classroom_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Append a completed lesson to the student's history and visited set.
+// Returns the new number of lessons attended. Caller holds school_mutex.
+int record_student_lesson(Simulation* sim, int student_id, int classroom_id) {
+    int lessons_attended = sim->student_lessons_attended[student_id];
+
+    student_history(sim, student_id)[lessons_attended] = classroom_id;
+    if (sim->student_visited != NULL) {
+        sim->student_visited[(size_t)student_id * sim->visited_words + (size_t)classroom_id / 64] |=
+            1ULL << (classroom_id % 64);
+    }
+
+    sim->student_lessons_attended[student_id] = ++lessons_attended;
+
+    if (lessons_attended < sim->config.required_lessons) {
+        sim->classroom_visited_active[classroom_id]++;
+    } else {
+        // Finished students no longer count towards the classrooms they visited
+        record_student_departure(sim, student_id);
+    }
+    return lessons_attended;
+}
+
+// Remove a student that is leaving school from the eligibility counters.
+// Called for early leavers and, via record_student_lesson, for finished ones.
+// Caller holds school_mutex.
+void record_student_departure(Simulation* sim, int student_id) {
+    int lessons_attended = sim->student_lessons_attended[student_id];
+    int* history = student_history(sim, student_id);
+
+    // The lesson that completed a student's requirements was never counted
+    if (lessons_attended == sim->config.required_lessons) {
+        lessons_attended--;
+    }
+
+    sim->active_students--;
+    for (int i = 0; i < lessons_attended; i++) {
+        sim->classroom_visited_active[history[i]]--;
+    }
+}
+
+// Number of students that could still attend a lesson in this classroom,
+// including those already inside. Caller holds school_mutex.
+int eligible_students_for_classroom(Simulation* sim, int classroom_id) {
+    return sim->active_students - sim->classroom_visited_active[classroom_id];
+}
+
+// Allocate zeroed memory or abort the program
+void* checked_calloc(size_t count, size_t size, const char* what) {
+    void* ptr = calloc(count, size);
+    if (ptr == NULL) {
+        fprintf(stderr, "Failed to allocate memory for %s\n", what);
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+// Zeroed array aligned to CACHE_LINE_SIZE; size must be a multiple of it
+void* checked_aligned_calloc(size_t count, size_t size, const char* what) {
+    void* ptr = aligned_alloc(CACHE_LINE_SIZE, count * size);
+    if (ptr == NULL) {
+        fprintf(stderr, "Failed to allocate memory for %s\n", what);
+        exit(EXIT_FAILURE);
+    }
+    memset(ptr, 0, count * size);
+    return ptr;
+}
+
+// Id of a call site, given the site's id slot (-1 until registered) and name
+int site_registry_id(SiteRegistry* registry, _Atomic int* site_id, const char* name) {
+    int id = atomic_load_explicit(site_id, memory_order_acquire);
+    if (id >= 0) {
+        return id;
+    }
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&registry->mutex), "Site registry lock");
+    id = atomic_load_explicit(site_id, memory_order_relaxed);
+    if (id < 0) {
+        if (registry->count == registry->capacity) {
+            fprintf(stderr, "Too many call sites, raise %s\n", registry->capacity_name);
+            exit(EXIT_FAILURE);
+        }
+        id = registry->count++;
+        registry->names[id] = name;
+        atomic_store_explicit(site_id, id, memory_order_release);
+    }
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&registry->mutex), "Site registry unlock");
+    return id;
+}
+
+// Number of sites registered so far; their names stay valid and unchanged
+int site_registry_count(SiteRegistry* registry) {
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&registry->mutex), "Site registry lock");
+    int count = registry->count;
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&registry->mutex), "Site registry unlock");
+    return count;
+}
+
+// Nanoseconds on the monotonic clock
+uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+// CPU time consumed so far by the calling thread
+double thread_cpu_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / NSEC_PER_SEC;
+}
+
+// Account the CPU time of one agent thread. Threads engines hold school_mutex.
+void record_thread_cpu(Simulation* sim, double seconds) {
+    sim->result.thread_cpu_sec += seconds;
+    if (seconds > sim->result.thread_cpu_max_sec) {
+        sim->result.thread_cpu_max_sec = seconds;
+    }
+}
+
+// Allocate a simulation context and all its size-dependent state, based on config
+Simulation* simulation_create(const SimConfig* config) {
+    Simulation* sim = checked_calloc(1, sizeof(Simulation), "simulation");
+    sim->config = *config;
+
+    size_t students = (size_t)config->total_students;
+    size_t teachers = (size_t)config->num_teachers;
+    size_t lessons = (size_t)config->required_lessons;
+
+    sim->classrooms = checked_aligned_calloc((size_t)config->num_classes, sizeof(Classroom), "classrooms");
+    for (int i = 0; i < config->num_classes; i++) {
+        sim->classrooms[i].roster_capacity = config->min_students_for_lesson;
+        sim->classrooms[i].roster = checked_calloc((size_t)sim->classrooms[i].roster_capacity, sizeof(int),
+                                                   "classroom roster");
+    }
+
+    sim->student_seats = checked_calloc(students, sizeof(StudentSeat), "student seats");
+    sim->classroom_visited_active = checked_calloc((size_t)config->num_classes, sizeof(int), "classroom eligibility");
+
+    if (config->engine != ENGINE_DES) {
+        sim->student_waiters = checked_calloc(students, sizeof(StudentWaiter), "student waiters");
+    }
+    sim->student_lessons_attended = checked_calloc(students, sizeof(int), "student attendance");
+    sim->teacher_lessons_taught = checked_calloc(teachers, sizeof(int), "teacher lesson counts");
+    sim->student_lesson_history = checked_calloc(students * lessons, sizeof(int), "student lesson history");
+    sim->teacher_lesson_history = checked_calloc(teachers * lessons, sizeof(int), "teacher lesson history");
+
+    sim->visited_words = ((size_t)config->num_classes + 63) / 64;
+    if (students * sim->visited_words * sizeof(uint64_t) <= VISITED_BITMAP_MAX_BYTES) {
+        sim->student_visited = checked_calloc(students * sim->visited_words, sizeof(uint64_t), "student visited sets");
+    }
+    if (config->engine != ENGINE_DES) {
+        sim->open_classrooms = checked_calloc(sim->visited_words, sizeof(_Atomic uint64_t), "open classroom bitmap");
+        latency_init(sim);
+        counters_init(sim);
+        if (config->trace_path != NULL) {
+            trace_init(sim);
+        }
+    }
+
+    if (config->lock_stats) {
+        sim->lock_sites = checked_calloc(MAX_LOCK_SITES, sizeof(LockCounters), "lock site counters");
+    }
+    if (config->wake_stats && config->engine != ENGINE_DES) {
+        sim->wake_sites = checked_calloc(MAX_WAKE_SITES, sizeof(WakeCounters), "wake site counters");
+    }
+
+    event_log_init(sim);
+
+    sim->result.attendance_count = checked_calloc(lessons + 1, sizeof(int), "attendance distribution");
+    sim->result.classroom_attendance = checked_calloc((size_t)config->num_classes, sizeof(int),
+                                                      "classroom utilization");
+    return sim;
+}
+
+// Release a context created by simulation_create
+void simulation_destroy(Simulation* sim) {
+    for (int i = 0; i < sim->config.num_classes; i++) {
+        free(sim->classrooms[i].roster);
+    }
+    free(sim->classrooms);
+    free(sim->student_seats);
+    free(sim->classroom_visited_active);
+    free(sim->student_waiters);
+    free(sim->student_lessons_attended);
+    free(sim->teacher_lessons_taught);
+    free(sim->student_lesson_history);
+    free(sim->teacher_lesson_history);
+    free(sim->student_visited);
+    free(sim->open_classrooms);
+    latency_free(sim);
+    counters_free(sim);
+    trace_free(sim);
+    event_log_free(sim);
+    free(sim->lock_sites);
+    free(sim->wake_sites);
+    free(sim->result.attendance_count);
+    free(sim->result.classroom_attendance);
+    free(sim);
+}
+
+// Classroom membership: a roster of ids plus a per-student seat tagged with the
+// classroom generation, so membership tests and resets are O(1).
+// Callers hold the classroom mutex (or run on the single event-engine thread).
+// The thread engines keep no roster and claim seats through the admission word.
+bool classroom_has_student(Simulation* sim, const Classroom* room, int student_id) {
+    const StudentSeat* seat = &sim->student_seats[student_id];
+    return seat->classroom_id == room->id && seat->generation == room->generation;
+}
+
+void classroom_add_student(Simulation* sim, Classroom* room, int student_id) {
+    if (room->students_count == room->roster_capacity) {
+        int capacity = room->roster_capacity * 2;
+        int* roster = realloc(room->roster, (size_t)capacity * sizeof(int));
+        if (roster == NULL) {
+            fprintf(stderr, "Failed to allocate memory for classroom roster\n");
+            exit(EXIT_FAILURE);
+        }
+        room->roster = roster;
+        room->roster_capacity = capacity;
+    }
+
+    room->roster[room->students_count++] = student_id;
+    sim->student_seats[student_id].classroom_id = room->id;
+    sim->student_seats[student_id].generation = room->generation;
+}
+
+void classroom_reset_students(Classroom* room) {
+    room->students_count = 0;
+    room->generation = (room->generation + 1) & ADMISSION_GENERATION_MASK;
+}
+
+// Lock-free admission of the thread engines. The teacher opens and closes
+// the room while holding the classroom mutex; students claim seats without it.
+void classroom_open_admission(Classroom* room) {
+    uint64_t word = ADMISSION_OPEN | ((uint64_t)room->generation << ADMISSION_GENERATION_SHIFT);
+    atomic_store_explicit(&room->admission, word, memory_order_release);
+}
+
+// Stop admitting students and return how many claimed a seat
+int classroom_close_admission(Classroom* room) {
+    uint64_t word = atomic_fetch_and_explicit(&room->admission, ~ADMISSION_OPEN, memory_order_acq_rel);
+    return (int)(word & ADMISSION_COUNT_MASK);
+}
+
+int classroom_seats_taken(const Classroom* room) {
+    return (int)(atomic_load_explicit(&room->admission, memory_order_acquire) & ADMISSION_COUNT_MASK);
+}
+
+// Claim a seat while the room is open. Returns the number of seats taken
+// including ours, or 0 if the room was closed or reopened meanwhile.
+int classroom_claim_seat(Simulation* sim, Classroom* room, int student_id) {
+    uint64_t word = atomic_load_explicit(&room->admission, memory_order_acquire);
+    for (;;) {
+        if (!(word & ADMISSION_OPEN)) {
+            return 0;
+        }
+        if (atomic_compare_exchange_weak_explicit(&room->admission, &word, word + 1,
+                                                  memory_order_acq_rel, memory_order_acquire)) {
+            break;
+        }
+    }
+
+    // Only this student touches its own seat
+    sim->student_seats[student_id].classroom_id = room->id;
+    sim->student_seats[student_id].generation =
+        (unsigned int)(word >> ADMISSION_GENERATION_SHIFT) & ADMISSION_GENERATION_MASK;
+    return (int)((word & ADMISSION_COUNT_MASK) + 1);
+}
+
+// Summarize the finished run into sim->result
+void collect_run_result(Simulation* sim) {
+    RunResult* result = &sim->result;
+
+    // Count completed lessons
+    result->students_completed = 0;
+    result->teachers_completed = 0;
+    result->lessons_taught = 0;
+
+    for (int i = 0; i < sim->config.total_students; i++) {
+        if (sim->student_lessons_attended[i] == sim->config.required_lessons) {
+            result->students_completed++;
+        }
+    }
+
+    for (int i = 0; i < sim->config.num_teachers; i++) {
+        result->lessons_taught += sim->teacher_lessons_taught[i];
+        if (sim->teacher_lessons_taught[i] == sim->config.required_lessons) {
+            result->teachers_completed++;
+        }
+    }
+
+    // Count for 0..required_lessons lessons
+    memset(result->attendance_count, 0, ((size_t)sim->config.required_lessons + 1) * sizeof(int));
+    for (int i = 0; i < sim->config.total_students; i++) {
+        result->attendance_count[sim->student_lessons_attended[i]]++;
+    }
+
+    memset(result->classroom_attendance, 0, (size_t)sim->config.num_classes * sizeof(int));
+    for (int i = 0; i < sim->config.total_students; i++) {
+        int* history = student_history(sim, i);
+        for (int j = 0; j < sim->student_lessons_attended[i]; j++) {
+            if (history[j] >= 0) {
+                result->classroom_attendance[history[j]]++;
+            }
+        }
+    }
+}
+
+// Generate simulation statistics
+void generate_simulation_stats(Simulation* sim, FILE* out) {
+    const RunResult* result = &sim->result;
+
+    // Print detailed summary
+    fprintf(out, "\n===== Simulation Summary =====\n");
+    fprintf(out, "Students who completed all lessons: %d/%d (%.1f%%)\n",
+            result->students_completed, sim->config.total_students,
+            (float)result->students_completed/sim->config.total_students * 100);
+    fprintf(out, "Teachers who completed all lessons: %d/%d (%.1f%%)\n",
+            result->teachers_completed, sim->config.num_teachers,
+            (float)result->teachers_completed/sim->config.num_teachers * 100);
+
+    // Print details about lessons per student
+    fprintf(out, "\nLesson attendance distribution:\n");
+    for (int i = 0; i <= sim->config.required_lessons; i++) {
+        fprintf(out, "  Students who attended %d lessons: %d\n", i, result->attendance_count[i]);
+    }
+
+    fprintf(out, "\nSimulated time: %.3f s\n", result->simulated_sec);
+
+    // Only the thread engines measure how long rooms wait for their quorum
+    if (sim->config.engine != ENGINE_DES && result->lessons_taught > 0) {
+        fprintf(out, "\nTime to start a lesson: %.3f ms average, %.3f ms max\n",
+                result->lesson_start_sec / result->lessons_taught * 1e3, result->lesson_start_max_sec * 1e3);
+    }
+    if (sim->config.engine != ENGINE_DES) {
+        print_latency_report(sim, out);
+    }
+
+    // Print classroom utilization
+    fprintf(out, "\nClassroom utilization:\n");
+    for (int i = 0; i < sim->config.num_classes; i++) {
+        fprintf(out, "  Classroom %d: %d students attended\n", i, result->classroom_attendance[i]);
+    }
+}
+
+// A single simulation run on a (reusable) context; results land in sim->result
+void project_zso(Simulation* sim) {
+    // Reset per-run state
+    sim->students_in_school = sim->config.total_students;
+    sim->remaining_teachers = sim->config.num_teachers;
+
+    // Reset tracking arrays
+    memset(sim->student_lessons_attended, 0, (size_t)sim->config.total_students * sizeof(int));
+    memset(sim->teacher_lessons_taught, 0, (size_t)sim->config.num_teachers * sizeof(int));
+
+    for (int i = 0; i < sim->config.total_students; i++) {
+        sim->student_seats[i].classroom_id = -1;
+    }
+
+    sim->active_students = sim->config.total_students;
+    memset(sim->classroom_visited_active, 0, (size_t)sim->config.num_classes * sizeof(int));
+
+    // Reset student and teacher lesson history
+    for (size_t i = 0; i < (size_t)sim->config.total_students * sim->config.required_lessons; i++) {
+        sim->student_lesson_history[i] = -1;
+    }
+
+    for (size_t i = 0; i < (size_t)sim->config.num_teachers * sim->config.required_lessons; i++) {
+        sim->teacher_lesson_history[i] = -1;
+    }
+
+    if (sim->student_visited != NULL) {
+        memset(sim->student_visited, 0, (size_t)sim->config.total_students * sim->visited_words * sizeof(uint64_t));
+    }
+
+    lock_stats_reset(sim);
+    wake_stats_reset(sim);
+    sim->result.thread_cpu_sec = 0;
+    sim->result.thread_cpu_max_sec = 0;
+    sim->result.lesson_start_sec = 0;
+    sim->result.lesson_start_max_sec = 0;
+    sim->result.simulated_sec = 0;
+
+    if (sim->event_buffers != NULL) {
+        event_log_begin_run(sim);
+    }
+
+    if (sim->config.engine == ENGINE_DES) {
+        double cpu_start = thread_cpu_seconds();
+        run_des_engine(sim);
+        record_thread_cpu(sim, thread_cpu_seconds() - cpu_start);
+    } else {
+        latency_reset(sim);
+        counters_reset(sim);
+        if (sim->trace_buffers != NULL) {
+            trace_reset(sim);
+        }
+        run_threads_engine(sim);
+        latency_collect(sim);
+        counters_collect(sim);
+    }
+
+    collect_run_result(sim);
+
+    if (sim->trace_buffers != NULL) {
+        trace_write(sim);
+    }
+    if (sim->event_buffers != NULL) {
+        event_log_end_run(sim);
+    }
+}
@@ -0,0 +1,998 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+
+#include "zso.h"
+
+// Thread-per-agent engine: every teacher and student is a pthread that
+// synchronizes through the classroom and school mutexes of its Simulation.
+// With ENGINE_COROUTINES the same agent bodies run as coroutines on the
+// shared worker pool of coro.c instead.
+
+// Per-thread argument: the run the agent belongs to, its id and its body
+typedef struct {
+    Simulation* sim;
+    int id;
+    int slot;                    // Scheduler slot: teachers first, then students
+    void* (*function)(void*);
+} AgentArg;
+
+// Absolute CLOCK_MONOTONIC deadline `seconds` from now, with nanosecond carry
+struct timespec deadline_after(double seconds) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    long long whole = (long long)seconds;
+    long long nanos = ts.tv_nsec + (long long)((seconds - (double)whole) * NSEC_PER_SEC);
+    ts.tv_sec += (time_t)(whole + nanos / NSEC_PER_SEC);
+    ts.tv_nsec = (long)(nanos % NSEC_PER_SEC);
+    return ts;
+}
+
+// Timeout for the next idle wait of an agent that has already waited
+// `idle_waits` times in a row without making progress
+double idle_wait_timeout(const Simulation* sim, int idle_waits) {
+    double timeout = sim->config.wait_timeout_sec;
+    if (sim->config.wait_policy == WAIT_POLICY_BACKOFF) {
+        for (int i = 0; i < idle_waits && timeout < sim->config.wait_timeout_sec * WAIT_BACKOFF_MAX_FACTOR; i++) {
+            timeout *= 2;
+        }
+    }
+    return timeout;
+}
+
+// Initialize a condition variable whose timed waits use CLOCK_MONOTONIC
+void init_monotonic_cond(pthread_cond_t* cond, const char* msg) {
+    pthread_condattr_t attr;
+    CHECK_PTHREAD_RETURN(pthread_condattr_init(&attr), msg);
+    CHECK_PTHREAD_RETURN(pthread_condattr_setclock(&attr, CLOCK_MONOTONIC), msg);
+    CHECK_PTHREAD_RETURN(pthread_cond_init(cond, &attr), msg);
+    CHECK_PTHREAD_RETURN(pthread_condattr_destroy(&attr), msg);
+}
+
+// Timed wait of the active engine, timeout_sec in simulated seconds
+static int engine_wait(Simulation* sim, pthread_cond_t* cond, pthread_mutex_t* mutex, double timeout_sec) {
+    if (sim->scheduler != NULL) {
+        return sched_wait(sim, cond, mutex, timeout_sec);
+    }
+    if (sim->virtual_clock != NULL) {
+        return clock_wait(sim, cond, mutex, timeout_sec);
+    }
+
+    // A positive time scale turns simulated seconds into real ones
+    double real_timeout = sim->config.time_scale > 0 ? timeout_sec * sim->config.time_scale : timeout_sec;
+    if (sim->config.engine == ENGINE_COROUTINES) {
+        return coro_wait(cond, mutex, real_timeout);
+    }
+
+    struct timespec deadline = deadline_after(real_timeout);
+    return pthread_cond_timedwait(cond, mutex, &deadline);
+}
+
+// Wait on a monotonic condition variable until signalled or timeout_sec of
+// simulated time passes. Under the deterministic scheduler the wait yields to
+// the next agent instead, and a coroutine agent parks and frees its worker.
+// Returns 0 or ETIMEDOUT; any other error is fatal.
+int wait_until(Simulation* sim, pthread_cond_t* cond, pthread_mutex_t* mutex, double timeout_sec, const char* msg) {
+    AgentCounters* counters = counters_current();
+    wake_stats_wait_begin(sim, cond);
+    lock_wait_begin(sim, mutex);
+    int wait_result = engine_wait(sim, cond, mutex, timeout_sec);
+    counters_restore(counters);
+    counters_set_waker(wake_stats_waker(sim, cond, wait_result));
+    lock_wait_end(sim, mutex);
+    if (wait_result != 0 && wait_result != ETIMEDOUT) {
+        fprintf(stderr, "%s failed: %s\n", msg, strerror(wait_result));
+        exit(EXIT_FAILURE);
+    }
+    return wait_result;
+}
+
+// Let seconds of simulated time pass on the agent's own timer, a condition
+// variable nobody signals
+void agent_sleep(Simulation* sim, double seconds) {
+    if (seconds <= 0) {
+        return;
+    }
+
+    pthread_mutex_t mutex;
+    pthread_cond_t timer;
+    CHECK_PTHREAD_RETURN(pthread_mutex_init(&mutex, NULL), "Agent timer mutex initialization");
+    init_monotonic_cond(&timer, "Agent timer initialization");
+
+    AgentCounters* counters = counters_current();
+    uint64_t deadline_ns = sim_now_ns(sim) + (uint64_t)(seconds * NSEC_PER_SEC);
+    CHECK_PTHREAD_RETURN(pthread_mutex_lock(&mutex), "Agent timer: lock");
+    for (;;) {
+        int result = engine_wait(sim, &timer, &mutex, seconds);
+        counters_restore(counters);
+        if (result == ETIMEDOUT) {
+            break;
+        }
+        CHECK_PTHREAD_RETURN(result, "Agent timer: wait");
+
+        // Spurious wakeup: sleep whatever is left
+        uint64_t now = sim_now_ns(sim);
+        if (now >= deadline_ns) {
+            break;
+        }
+        seconds = (double)(deadline_ns - now) / NSEC_PER_SEC;
+    }
+    CHECK_PTHREAD_RETURN(pthread_mutex_unlock(&mutex), "Agent timer: unlock");
+
+    CHECK_PTHREAD_RETURN(pthread_cond_destroy(&timer), "Agent timer destruction");
+    CHECK_PTHREAD_RETURN(pthread_mutex_destroy(&mutex), "Agent timer mutex destruction");
+}
+
+// Wake one (or, with broadcast, every) agent waiting on cond; see SIGNAL_COND
+void signal_cond(Simulation* sim, pthread_cond_t* cond, bool broadcast, WakeSite* site) {
+    const char* msg = site->name;
+    if (broadcast) {
+        counter_add(COUNTER_BROADCASTS);
+    }
+    if (sim->wake_sites != NULL) {
+        wake_stats_signal(sim, cond, broadcast, site);
+    }
+    if (sim->scheduler != NULL) {
+        sched_signal(sim, cond, broadcast);
+    } else if (sim->virtual_clock != NULL) {
+        clock_signal(sim, cond, broadcast);
+    } else if (sim->config.engine == ENGINE_COROUTINES) {
+        coro_signal(cond, broadcast);
+    } else if (broadcast) {
+        CHECK_PTHREAD_RETURN(pthread_cond_broadcast(cond), msg);
+    } else {
+        CHECK_PTHREAD_RETURN(pthread_cond_signal(cond), msg);
+    }
+}
+
+// Waiting-student FIFO helpers. Caller holds school_mutex.
+void enqueue_waiting_student(Simulation* sim, int student_id) {
+    StudentWaiter* waiter = &sim->student_waiters[student_id];
+    waiter->waiting = true;
+    waiter->next = -1;
+    waiter->prev = sim->waiters_tail;
+    if (sim->waiters_tail >= 0) {
+        sim->student_waiters[sim->waiters_tail].next = student_id;
+    } else {
+        sim->waiters_head = student_id;
+    }
+    sim->waiters_tail = student_id;
+}
+
+void remove_waiting_student(Simulation* sim, int student_id) {
+    StudentWaiter* waiter = &sim->student_waiters[student_id];
+    if (waiter->prev >= 0) {
+        sim->student_waiters[waiter->prev].next = waiter->next;
+    } else {
+        sim->waiters_head = waiter->next;
+    }
+    if (waiter->next >= 0) {
+        sim->student_waiters[waiter->next].prev = waiter->prev;
+    } else {
+        sim->waiters_tail = waiter->prev;
+    }
+    waiter->waiting = false;
+}
+
+// Wake up to max_wakeups waiting students that have not attended this classroom.
+// Returns the number of students woken. Caller holds school_mutex.
+int wake_eligible_students(Simulation* sim, int classroom_id, int max_wakeups) {
+    int woken = 0;
+    int student_id = sim->waiters_head;
+
+    while (student_id >= 0 && woken < max_wakeups) {
+        int next = sim->student_waiters[student_id].next;
+        if (!student_already_attended_classroom(sim, student_id, classroom_id, sim->student_lessons_attended[student_id])) {
+            remove_waiting_student(sim, student_id);
+            SIGNAL_COND(sim, &sim->student_waiters[student_id].wakeup_cv, false,
+                        "Teacher: waking eligible student");
+            woken++;
+        }
+        student_id = next;
+    }
+    return woken;
+}
+
+// Wake every waiting student, e.g. when the last teacher leaves. Caller holds school_mutex.
+void wake_all_students(Simulation* sim) {
+    while (sim->waiters_head >= 0) {
+        int student_id = sim->waiters_head;
+        remove_waiting_student(sim, student_id);
+        SIGNAL_COND(sim, &sim->student_waiters[student_id].wakeup_cv, false,
+                    "Teacher: waking all students");
+    }
+}
+
+// Open-classroom bitmap: a classroom's bit is set while its teacher waits
+// for students. Teachers flip it under the classroom mutex; students scan it
+// without locking and lock only the room they try to join, where the state
+// is checked again, so probing cost follows the number of open rooms.
+static void set_classroom_open(Simulation* sim, int classroom_id, bool open) {
+    uint64_t bit = 1ULL << (classroom_id % 64);
+    if (open) {
+        atomic_fetch_or_explicit(&sim->open_classrooms[classroom_id / 64], bit, memory_order_release);
+    } else {
+        atomic_fetch_and_explicit(&sim->open_classrooms[classroom_id / 64], ~bit, memory_order_release);
+    }
+}
+
+// First open classroom with id >= from that the student has not attended yet, or -1.
+// Only the student itself writes its visited set, so reading it needs no lock.
+static int next_open_classroom(Simulation* sim, int student_id, int from) {
+    if (from >= sim->config.num_classes) {
+        return -1;
+    }
+
+    const uint64_t* visited = NULL;
+    if (sim->student_visited != NULL) {
+        visited = &sim->student_visited[(size_t)student_id * sim->visited_words];
+    }
+
+    size_t word = (size_t)from / 64;
+    uint64_t bits = atomic_load_explicit(&sim->open_classrooms[word], memory_order_acquire) & (~0ULL << (from % 64));
+    for (;;) {
+        if (visited != NULL) {
+            bits &= ~visited[word];
+        }
+        if (bits != 0) {
+            return (int)(word * 64 + (size_t)__builtin_ctzll(bits));
+        }
+        if (++word >= sim->visited_words) {
+            return -1;
+        }
+        bits = atomic_load_explicit(&sim->open_classrooms[word], memory_order_acquire);
+    }
+}
+
+// Initialize the classrooms
+void initialize_classrooms(Simulation* sim) {
+    for (int i = 0; i < sim->config.num_classes; i++) {
+        sim->classrooms[i].id = i;
+        sim->classrooms[i].state = LESSON_WAITING;
+        sim->classrooms[i].teacher_id = -1;
+        classroom_reset_students(&sim->classrooms[i]);
+        atomic_store(&sim->classrooms[i].admission, 0);
+
+        CHECK_PTHREAD_RETURN(pthread_mutex_init(&sim->classrooms[i].mutex, NULL),
+                            "Classroom mutex initialization");
+        init_monotonic_cond(&sim->classrooms[i].lesson_start_cv, "Classroom start condition initialization");
+        init_monotonic_cond(&sim->classrooms[i].lesson_end_cv, "Classroom end condition initialization");
+        sim->classrooms[i].start_wake = (WakeTag){ 0 };
+        sim->classrooms[i].end_wake = (WakeTag){ 0 };
+    }
+
+    for (size_t i = 0; i < sim->visited_words; i++) {
+        atomic_store(&sim->open_classrooms[i], 0);
+    }
+
+    CHECK_PTHREAD_RETURN(pthread_mutex_init(&sim->school_mutex, NULL),
+                        "School mutex initialization");
+
+    sim->waiters_head = -1;
+    sim->waiters_tail = -1;
+    init_monotonic_cond(&sim->matcher_cv, "Matcher condition initialization");
+    sim->matcher_wake = (WakeTag){ 0 };
+    for (int i = 0; i < sim->config.total_students; i++) {
+        sim->student_waiters[i].waiting = false;
+        sim->student_waiters[i].wake = (WakeTag){ 0 };
+        init_monotonic_cond(&sim->student_waiters[i].wakeup_cv, "Student wakeup condition initialization");
+    }
+}
+
+// Clean up resources
+void cleanup_resources(Simulation* sim) {
+    for (int i = 0; i < sim->config.num_classes; i++) {
+        // FIX: Destroy condition variables before mutexes
+        CHECK_PTHREAD_RETURN(pthread_cond_destroy(&sim->classrooms[i].lesson_start_cv),
+                            "Classroom start condition destruction");
+        CHECK_PTHREAD_RETURN(pthread_cond_destroy(&sim->classrooms[i].lesson_end_cv),
+                            "Classroom end condition destruction");
+        CHECK_PTHREAD_RETURN(pthread_mutex_destroy(&sim->classrooms[i].mutex),
+                            "Classroom mutex destruction");
+    }
+
+    // FIX: Destroy condition variables before mutex
+    for (int i = 0; i < sim->config.total_students; i++) {
+        CHECK_PTHREAD_RETURN(pthread_cond_destroy(&sim->student_waiters[i].wakeup_cv),
+                            "Student wakeup condition destruction");
+    }
+    CHECK_PTHREAD_RETURN(pthread_cond_destroy(&sim->matcher_cv),
+                        "Matcher condition destruction");
+    CHECK_PTHREAD_RETURN(pthread_mutex_destroy(&sim->school_mutex),
+                        "School mutex destruction");
+}
+
+// Check if there are enough students left in school for a regular lesson
+// Caller MUST hold school_mutex before calling this function
+bool enough_students_for_regular_lesson(Simulation* sim) {
+    return sim->students_in_school >= sim->config.min_students_for_lesson;
+}
+
+// Helper to get students in school safely
+int get_students_in_school(Simulation* sim) {
+    int count;
+    LOCK_MUTEX(sim, &sim->school_mutex,
+               "get_students_in_school: lock");
+    count = sim->students_in_school;
+    UNLOCK_MUTEX(sim, &sim->school_mutex,
+                 "get_students_in_school: unlock");
+    return count;
+}
+
+// Teacher thread function
+void* teacher_function(void* arg) {
+    AgentArg* agent = arg;
+    Simulation* sim = agent->sim;
+    int teacher_id = agent->id;
+
+    log_message(LOG_INFO, "Teacher %d has arrived at school.\n", teacher_id);
+
+    int classroom_id = teacher_id; // Each teacher has a designated classroom
+    int lessons_taught = 0;
+    int consecutive_timeouts = 0; // Track consecutive timeouts
+
+    while (lessons_taught < sim->config.required_lessons) {
+        log_message(LOG_INFO, "Teacher %d preparing for lesson %d in classroom %d.\n",
+                   teacher_id, lessons_taught + 1, classroom_id);
+
+        // First check if we should start with fewer students
+        bool start_with_fewer = false;
+
+        LOCK_MUTEX(sim, &sim->school_mutex,
+                   "Teacher: school mutex lock");
+
+        // Check and update school state
+        start_with_fewer = (sim->students_in_school < sim->config.min_students_for_lesson);
+
+        UNLOCK_MUTEX(sim, &sim->school_mutex,
+                     "Teacher: school mutex unlock");
+
+        LOCK_MUTEX(sim, &sim->classrooms[classroom_id].mutex,
+                   "Teacher: classroom mutex lock");
+
+        // Mark this classroom as having a teacher
+        sim->classrooms[classroom_id].teacher_id = teacher_id;
+        sim->classrooms[classroom_id].state = LESSON_WAITING;
+        classroom_open_admission(&sim->classrooms[classroom_id]);
+        set_classroom_open(sim, classroom_id, true);
+        uint64_t opened_at_ns = sim_now_ns(sim);
+        event_log_emit(sim, teacher_id, EVENT_LOG_TEACHER_OPEN, opened_at_ns, (uint64_t)classroom_id);
+        bool waited = !start_with_fewer;
+
+        if (!start_with_fewer) {
+            // Regular case: wait for enough students
+            int wait_count = 0;
+            int max_waits = 3; // Maximum number of timeout waits before checking conditions
+
+            while (classroom_seats_taken(&sim->classrooms[classroom_id]) < sim->config.min_students_for_lesson) {
+                int missing_students = sim->config.min_students_for_lesson -
+                                       classroom_seats_taken(&sim->classrooms[classroom_id]);
+
+                // Before waiting, check again if we should start with fewer
+                UNLOCK_MUTEX(sim, &sim->classrooms[classroom_id].mutex,
+                             "Teacher: temporary classroom mutex unlock for school check");
+
+                LOCK_MUTEX(sim, &sim->school_mutex,
+                           "Teacher: school mutex lock in wait loop");
+
+                start_with_fewer = (sim->students_in_school < sim->config.min_students_for_lesson);
+
+                // Check if there are enough students left in school who haven't attended this teacher's class
+                int available_students = eligible_students_for_classroom(sim, classroom_id);
+
+                // If not enough eligible students remain for this class, start with fewer
+                if (available_students < sim->config.min_students_for_lesson) {
+                    log_message(LOG_INFO, "Teacher %d detected only %d eligible students remain for classroom %d.\n",
+                              teacher_id, available_students, classroom_id);
+                    start_with_fewer = true;
+                }
+
+                // Wake only as many waiting students as seats still missing,
+                // or leave the seating to the matcher
+                if (!start_with_fewer) {
+                    if (sim->config.matcher) {
+                        matcher_notify(sim);
+                    } else {
+                        wake_eligible_students(sim, classroom_id, missing_students);
+                    }
+                }
+
+                UNLOCK_MUTEX(sim, &sim->school_mutex,
+                             "Teacher: school mutex unlock in wait loop");
+
+                LOCK_MUTEX(sim, &sim->classrooms[classroom_id].mutex,
+                           "Teacher: re-acquire classroom mutex in wait loop");
+
+                if (start_with_fewer || wait_count >= max_waits) {
+                    // Start with fewer students after max timeouts or if conditions changed
+                    if (wait_count >= max_waits) {
+                        log_message(LOG_INFO, "Teacher %d timed out %d times waiting for students. Starting with %d students.\n",
+                                  teacher_id, wait_count, classroom_seats_taken(&sim->classrooms[classroom_id]));
+                    }
+                    break;
+                }
+
+                log_message(LOG_DEBUG, "Teacher %d waiting for students. Current count: %d\n",
+                           teacher_id, classroom_seats_taken(&sim->classrooms[classroom_id]));
+
+                // Use a timed wait to prevent indefinite waiting
+                int wait_result = wait_until(sim, &sim->classrooms[classroom_id].lesson_start_cv,
+                                             &sim->classrooms[classroom_id].mutex,
+                                             sim->config.wait_timeout_sec, "Teacher: waiting for students");
+                counter_wait_result(wait_result, classroom_seats_taken(&sim->classrooms[classroom_id]) >=
+                                                 sim->config.min_students_for_lesson);
+
+                if (wait_result == ETIMEDOUT) {
+                    wait_count++;
+                    consecutive_timeouts++;
+                    event_log_emit(sim, teacher_id, EVENT_LOG_TEACHER_TIMEOUT, sim_now_ns(sim),
+                                   (uint64_t)classroom_id);
+                    ZSO_PROBE(teacher_timeout, teacher_id, -1, classroom_id);
+
+                    log_message(LOG_DEBUG, "Teacher %d timed out waiting for students (timeout #%d).\n",
+                              teacher_id, consecutive_timeouts);
+                } else {
+                    // Successfully woke up because a student joined
+                    consecutive_timeouts = 0;
+                }
+
+                // The next iteration re-checks the school and wakes more students if needed
+            }
+        }
+
+        // Reset timeout counter since we're starting a lesson
+        consecutive_timeouts = 0;
+
+        // Start the lesson; closing admission fixes who is in it
+        sim->classrooms[classroom_id].students_count = classroom_close_admission(&sim->classrooms[classroom_id]);
+        sim->classrooms[classroom_id].state = LESSON_IN_PROGRESS;
+        set_classroom_open(sim, classroom_id, false);
+        uint64_t started_at_ns = sim_now_ns(sim);
+        double time_to_start = (double)(started_at_ns - opened_at_ns) / NSEC_PER_SEC;
+        if (waited) {
+            latency_record(sim, LATENCY_TEACHER_WAIT, teacher_id, lessons_taught, started_at_ns - opened_at_ns);
+        }
+        trace_span(sim, teacher_id, TRACE_TEACHER_WAITING, classroom_id, opened_at_ns, started_at_ns);
+        event_log_emit(sim, teacher_id, EVENT_LOG_LESSON_START, started_at_ns,
+                       (uint64_t)sim->classrooms[classroom_id].students_count * 2 + (waited ? 1 : 0));
+        ZSO_PROBE(lesson_start, teacher_id, -1, classroom_id);
+        log_message(LOG_INFO, "Teacher %d starting lesson in classroom %d with %d students%s.\n",
+                   teacher_id, classroom_id, sim->classrooms[classroom_id].students_count,
+                   start_with_fewer ? " (fewer than required)" : "");
+
+        // Signal all students that the lesson has started
+        SIGNAL_COND(sim, &sim->classrooms[classroom_id].lesson_start_cv, true,
+                    "Teacher: broadcasting lesson start");
+
+        UNLOCK_MUTEX(sim, &sim->classrooms[classroom_id].mutex,
+                     "Teacher: classroom mutex unlock after starting");
+
+        // Conduct the lesson
+        agent_sleep(sim, sim->config.lesson_duration_sec);
+
+        // End the lesson
+        LOCK_MUTEX(sim, &sim->classrooms[classroom_id].mutex,
+                   "Teacher: classroom mutex lock for ending");
+
+        sim->classrooms[classroom_id].state = LESSON_ENDED;
+        uint64_t ended_at_ns = sim_now_ns(sim);
+        trace_span(sim, teacher_id, TRACE_TEACHING, classroom_id, started_at_ns, ended_at_ns);
+        event_log_emit(sim, teacher_id, EVENT_LOG_LESSON_END, ended_at_ns, (uint64_t)classroom_id);
+        ZSO_PROBE(lesson_end, teacher_id, -1, classroom_id);
+        log_message(LOG_INFO, "Teacher %d ending lesson in classroom %d.\n",
+                   teacher_id, classroom_id);
+
+        // Signal all students that the lesson has ended
+        SIGNAL_COND(sim, &sim->classrooms[classroom_id].lesson_end_cv, true,
+                    "Teacher: broadcasting lesson end");
+
+        UNLOCK_MUTEX(sim, &sim->classrooms[classroom_id].mutex,
+                     "Teacher: classroom mutex unlock after ending");
+
+        // Update teacher lessons taught with school mutex
+        LOCK_MUTEX(sim, &sim->school_mutex,
+                   "Teacher: school mutex lock for history update");
+
+        // Record this lesson
+        teacher_history(sim, teacher_id)[lessons_taught] = classroom_id;
+        sim->result.lesson_start_sec += time_to_start;
+        if (time_to_start > sim->result.lesson_start_max_sec) {
+            sim->result.lesson_start_max_sec = time_to_start;
+        }
+        lessons_taught++;
+        sim->teacher_lessons_taught[teacher_id] = lessons_taught;
+
+        UNLOCK_MUTEX(sim, &sim->school_mutex,
+                     "Teacher: school mutex unlock after history update");
+
+        // Reset the classroom for the next lesson
+        LOCK_MUTEX(sim, &sim->classrooms[classroom_id].mutex,
+                   "Teacher: classroom mutex lock for reset");
+
+        classroom_reset_students(&sim->classrooms[classroom_id]);
+        sim->classrooms[classroom_id].teacher_id = -1;
+        ZSO_PROBE(classroom_reset, teacher_id, -1, classroom_id);
+
+        UNLOCK_MUTEX(sim, &sim->classrooms[classroom_id].mutex,
+                     "Teacher: classroom mutex unlock after reset");
+
+        trace_span(sim, teacher_id, TRACE_RESETTING, classroom_id, ended_at_ns, sim_now_ns(sim));
+    }
+
+    // Teacher has taught required number of lessons
+    LOCK_MUTEX(sim, &sim->school_mutex,
+               "Teacher: school mutex lock for exit");
+
+    sim->remaining_teachers--;
+    event_log_emit(sim, teacher_id, EVENT_LOG_TEACHER_LEAVE, sim_now_ns(sim), (uint64_t)lessons_taught);
+    log_message(LOG_INFO, "Teacher %d has completed all required lessons and is leaving. Teachers remaining: %d\n",
+               teacher_id, sim->remaining_teachers);
+
+    // The last teacher sends every waiting student home
+    if (sim->remaining_teachers == 0) {
+        wake_all_students(sim);
+        if (sim->config.matcher) {
+            matcher_notify(sim);
+        }
+    }
+
+    UNLOCK_MUTEX(sim, &sim->school_mutex,
+                 "Teacher: school mutex unlock after exit");
+
+    return NULL;
+}
+
+// Matcher agent, see matcher.c
+void* matcher_function(void* arg) {
+    AgentArg* agent = arg;
+    run_matcher(agent->sim);
+    return NULL;
+}
+
+// Join classroom i if it still accepts students. Returns true once joined.
+static bool try_join_classroom(Simulation* sim, int student_id, int i, int lessons_attended) {
+    counter_add(COUNTER_PROBES);
+
+    // Without visited bitmaps the open-classroom scan cannot skip attended rooms
+    if (sim->student_visited == NULL) {
+        LOCK_MUTEX(sim, &sim->school_mutex,
+                   "Student: school mutex lock for history check");
+
+        bool already_attended = student_already_attended_classroom(sim, student_id, i, lessons_attended);
+
+        UNLOCK_MUTEX(sim, &sim->school_mutex,
+                     "Student: school mutex unlock after history check");
+
+        if (already_attended) {
+            counter_add(COUNTER_FAILED_JOINS);
+            return false;
+        }
+    }
+
+    // Claim a seat without the classroom mutex; fails if the teacher closed the room
+    int seats = classroom_claim_seat(sim, &sim->classrooms[i], student_id);
+    if (seats == 0) {
+        counter_add(COUNTER_FAILED_JOINS);
+        return false;
+    }
+
+    log_message(LOG_INFO, "Student %d joined classroom %d. Student count: %d\n",
+               student_id, i, seats);
+
+    // Signal teacher if enough students have arrived. Signalling under the
+    // mutex keeps the wakeup from slipping in between the teacher's check
+    // and its wait.
+    if (seats >= sim->config.min_students_for_lesson) {
+        LOCK_MUTEX(sim, &sim->classrooms[i].mutex,
+                   "Student: classroom mutex lock to signal teacher");
+
+        SIGNAL_COND(sim, &sim->classrooms[i].lesson_start_cv, false,
+                    "Student: signaling lesson start");
+
+        UNLOCK_MUTEX(sim, &sim->classrooms[i].mutex,
+                     "Student: classroom mutex unlock after signalling teacher");
+    }
+    return true;
+}
+
+// Charge an idle student's last wakeup once it is clear whether it led to a
+// seat or out of school (progress), or just to another wait
+static void settle_idle_wakeup(bool* woken, bool progress) {
+    if (*woken) {
+        counter_wait_result(0, progress);
+        *woken = false;
+    }
+}
+
+// Student thread function
+void* student_function(void* arg) {
+    AgentArg* agent = arg;
+    Simulation* sim = agent->sim;
+    int student_id = agent->id;
+
+    log_message(LOG_INFO, "Student %d has arrived at school.\n", student_id);
+
+    int lessons_attended = 0;
+    int idle_waits = 0; // Consecutive waits without finding a classroom
+    bool searching = false;
+    bool woken = false;  // Idle wait ended by a signal, not settled yet
+    uint64_t search_start_ns = 0;
+    int agent_slot = sim->config.num_teachers + student_id;
+
+    while (lessons_attended < sim->config.required_lessons) {
+        // Check if any teachers are left in the school
+        LOCK_MUTEX(sim, &sim->school_mutex,
+                   "Student: school mutex lock");
+
+        if (sim->remaining_teachers == 0) {
+            // No teachers left, student should leave
+            sim->students_in_school--;
+            record_student_departure(sim, student_id);
+            settle_idle_wakeup(&woken, true);
+            event_log_emit(sim, agent_slot, EVENT_LOG_STUDENT_LEAVE, sim_now_ns(sim), (uint64_t)lessons_attended);
+            ZSO_PROBE(student_leave, -1, student_id, -1);
+            log_message(LOG_INFO, "Student %d is leaving because no teachers remain. Lessons attended: %d/%d\n",
+                      student_id, lessons_attended, sim->config.required_lessons);
+
+            UNLOCK_MUTEX(sim, &sim->school_mutex,
+                         "Student: school mutex unlock (no teachers)");
+            return NULL;
+        }
+
+        UNLOCK_MUTEX(sim, &sim->school_mutex,
+                     "Student: school mutex unlock");
+
+        // Failed searches and waits count towards the same lesson
+        if (!searching) {
+            search_start_ns = sim_now_ns(sim);
+            searching = true;
+            event_log_emit(sim, agent_slot, EVENT_LOG_STUDENT_SEARCH, search_start_ns, 0);
+        }
+
+        // Look for an open classroom, starting at our own and wrapping around.
+        // With the matcher students never probe and queue up right away.
+        int start = student_id % sim->config.num_classes;
+        int chosen_classroom = -1;
+        for (int i = next_open_classroom(sim, student_id, start);
+             i >= 0 && chosen_classroom < 0 && !sim->config.matcher;
+             i = next_open_classroom(sim, student_id, i + 1)) {
+            if (try_join_classroom(sim, student_id, i, lessons_attended)) {
+                chosen_classroom = i;
+            }
+        }
+        for (int i = next_open_classroom(sim, student_id, 0);
+             i >= 0 && i < start && chosen_classroom < 0 && !sim->config.matcher;
+             i = next_open_classroom(sim, student_id, i + 1)) {
+            if (try_join_classroom(sim, student_id, i, lessons_attended)) {
+                chosen_classroom = i;
+            }
+        }
+        bool found_classroom = chosen_classroom >= 0;
+
+        if (!found_classroom) {
+            // If we couldn't find a classroom, we need to wait for a change
+            // Get the school mutex to check and update global state
+            LOCK_MUTEX(sim, &sim->school_mutex,
+                       "Student: school mutex lock for wait");
+
+            // CRITICAL FIX: Check for remaining teachers again before waiting
+            if (sim->remaining_teachers == 0) {
+                // No teachers left, student should leave
+                sim->students_in_school--;
+                record_student_departure(sim, student_id);
+                settle_idle_wakeup(&woken, true);
+                event_log_emit(sim, agent_slot, EVENT_LOG_STUDENT_LEAVE, sim_now_ns(sim), (uint64_t)lessons_attended);
+                ZSO_PROBE(student_leave, -1, student_id, -1);
+                log_message(LOG_INFO, "Student %d is leaving because no teachers remain. Lessons attended: %d/%d\n",
+                          student_id, lessons_attended, sim->config.required_lessons);
+
+                UNLOCK_MUTEX(sim, &sim->school_mutex,
+                             "Student: school mutex unlock (no teachers)");
+                return NULL;
+            }
+
+            // Use a timed wait instead of indefinite wait to prevent deadlock;
+            // the wait policy decides how long to sleep after repeated misses
+            double timeout = idle_wait_timeout(sim, idle_waits);
+            idle_waits++;
+
+            // Sleep until a teacher opening an eligible classroom picks us,
+            // or the matcher seats us
+            settle_idle_wakeup(&woken, false);
+            sim->student_waiters[student_id].assigned_classroom = -1;
+            enqueue_waiting_student(sim, student_id);
+            if (sim->config.matcher) {
+                matcher_notify(sim);
+            }
+            int wait_result = wait_until(sim, &sim->student_waiters[student_id].wakeup_cv, &sim->school_mutex,
+                                         timeout, "Student: waiting for a classroom");
+            if (wait_result == ETIMEDOUT) {
+                event_log_emit(sim, agent_slot, EVENT_LOG_STUDENT_TIMEOUT, sim_now_ns(sim), 0);
+                counter_wait_result(wait_result, false);
+            } else {
+                // Settled after the next search: a join or leaving is progress
+                woken = true;
+            }
+            if (sim->student_waiters[student_id].waiting) {
+                remove_waiting_student(sim, student_id);
+            }
+
+            // FIX: After wait, recheck conditions before continuing
+            if (sim->remaining_teachers == 0) {
+                // No teachers left, student should leave
+                sim->students_in_school--;
+                record_student_departure(sim, student_id);
+                settle_idle_wakeup(&woken, true);
+                event_log_emit(sim, agent_slot, EVENT_LOG_STUDENT_LEAVE, sim_now_ns(sim), (uint64_t)lessons_attended);
+                ZSO_PROBE(student_leave, -1, student_id, -1);
+                log_message(LOG_INFO, "Student %d is leaving because no teachers remain. Lessons attended: %d/%d\n",
+                          student_id, lessons_attended, sim->config.required_lessons);
+
+                UNLOCK_MUTEX(sim, &sim->school_mutex,
+                             "Student: school mutex unlock (no teachers)");
+                return NULL;
+            }
+
+            chosen_classroom = sim->student_waiters[student_id].assigned_classroom;
+
+            UNLOCK_MUTEX(sim, &sim->school_mutex,
+                         "Student: school mutex unlock after wait");
+            if (chosen_classroom < 0) {
+                continue;
+            }
+        }
+
+        idle_waits = 0;
+        settle_idle_wakeup(&woken, true);
+        uint64_t joined_at_ns = sim_now_ns(sim);
+        latency_record(sim, LATENCY_SEARCH_TO_JOIN, student_id, lessons_attended, joined_at_ns - search_start_ns);
+        trace_span(sim, agent_slot, TRACE_STUDENT_SEARCHING, chosen_classroom, search_start_ns, joined_at_ns);
+        event_log_emit(sim, agent_slot, EVENT_LOG_STUDENT_JOIN, joined_at_ns, (uint64_t)chosen_classroom);
+        // Each teacher teaches in its designated classroom
+        ZSO_PROBE(student_join, chosen_classroom, student_id, chosen_classroom);
+
+        // Wait for the lesson to start and end
+        LOCK_MUTEX(sim, &sim->classrooms[chosen_classroom].mutex,
+                   "Student: classroom mutex lock (waiting for lesson)");
+
+        // Wait if the lesson hasn't started yet. A reset seat means the teacher
+        // already ran and closed our lesson while we were not scheduled.
+        while (sim->classrooms[chosen_classroom].state == LESSON_WAITING &&
+               classroom_has_student(sim, &sim->classrooms[chosen_classroom], student_id)) {
+            // Use a timed wait to prevent indefinite blocking
+            int wait_result = wait_until(sim, &sim->classrooms[chosen_classroom].lesson_start_cv,
+                                         &sim->classrooms[chosen_classroom].mutex,
+                                         sim->config.wait_timeout_sec, "Student: waiting for lesson start");
+            counter_wait_result(wait_result, sim->classrooms[chosen_classroom].state != LESSON_WAITING ||
+                                !classroom_has_student(sim, &sim->classrooms[chosen_classroom], student_id));
+
+            // FIX: Recheck conditions every time after wake up
+            if (sim->classrooms[chosen_classroom].state != LESSON_WAITING) {
+                break;
+            }
+        }
+
+        uint64_t lesson_seen_ns = sim_now_ns(sim);
+        latency_record(sim, LATENCY_JOIN_TO_START, student_id, lessons_attended, lesson_seen_ns - joined_at_ns);
+        trace_span(sim, agent_slot, TRACE_STUDENT_WAITING, chosen_classroom, joined_at_ns, lesson_seen_ns);
+        event_log_emit(sim, agent_slot, EVENT_LOG_LESSON_SEEN, lesson_seen_ns, (uint64_t)chosen_classroom);
+
+        // Participate in the lesson
+        log_message(LOG_DEBUG, "Student %d participating in lesson in classroom %d.\n",
+                   student_id, chosen_classroom);
+
+        // Wait for the lesson to end
+        while (sim->classrooms[chosen_classroom].state == LESSON_IN_PROGRESS &&
+               classroom_has_student(sim, &sim->classrooms[chosen_classroom], student_id)) {
+            // Use a timed wait to prevent indefinite blocking
+            int wait_result = wait_until(sim, &sim->classrooms[chosen_classroom].lesson_end_cv,
+                                         &sim->classrooms[chosen_classroom].mutex,
+                                         sim->config.wait_timeout_sec, "Student: waiting for lesson end");
+            counter_wait_result(wait_result, sim->classrooms[chosen_classroom].state != LESSON_IN_PROGRESS ||
+                                !classroom_has_student(sim, &sim->classrooms[chosen_classroom], student_id));
+
+            // FIX: After timeout, check if lesson state has changed
+            if (sim->classrooms[chosen_classroom].state != LESSON_IN_PROGRESS) {
+                break;
+            }
+        }
+
+        // Lesson has ended, store the classroom ID temporarily
+        int completed_classroom = chosen_classroom;
+        uint64_t lesson_over_ns = sim_now_ns(sim);
+        trace_span(sim, agent_slot, TRACE_IN_LESSON, completed_classroom, lesson_seen_ns, lesson_over_ns);
+
+        // Release classroom mutex before getting school mutex to maintain proper locking order
+        UNLOCK_MUTEX(sim, &sim->classrooms[chosen_classroom].mutex,
+                     "Student: classroom mutex unlock (lesson complete)");
+
+        // Get school mutex to update attendance information
+        LOCK_MUTEX(sim, &sim->school_mutex,
+                   "Student: school mutex lock for attendance update");
+
+        // Record this lesson
+        latency_record(sim, LATENCY_TURNAROUND, student_id, lessons_attended, lesson_over_ns - search_start_ns);
+        searching = false;
+        event_log_emit(sim, agent_slot, EVENT_LOG_STUDENT_COMPLETE, lesson_over_ns, (uint64_t)completed_classroom);
+        ZSO_PROBE(student_complete, completed_classroom, student_id, completed_classroom);
+        lessons_attended = record_student_lesson(sim, student_id, completed_classroom);
+
+        log_message(LOG_INFO, "Student %d completed lesson in classroom %d. Lessons attended: %d/%d\n",
+                   student_id, completed_classroom, lessons_attended, sim->config.required_lessons);
+
+        UNLOCK_MUTEX(sim, &sim->school_mutex,
+                     "Student: school mutex unlock (attendance update)");
+    }
+
+    // Student has attended required number of lessons
+    LOCK_MUTEX(sim, &sim->school_mutex,
+               "Student: school mutex lock (exit)");
+
+    sim->students_in_school--;
+    event_log_emit(sim, agent_slot, EVENT_LOG_STUDENT_LEAVE, sim_now_ns(sim), (uint64_t)lessons_attended);
+    log_message(LOG_INFO, "Student %d has completed all required lessons and is leaving. Students remaining: %d\n",
+               student_id, sim->students_in_school);
+
+    UNLOCK_MUTEX(sim, &sim->school_mutex,
+                 "Student: school mutex unlock (exit)");
+
+    return NULL;
+}
+
+// Agent body with the agent's event counters bound to the running thread
+static void* agent_body(void* arg) {
+    AgentArg* agent = arg;
+    counters_bind(agent->sim, agent->slot);
+    agent->function(agent);
+    counters_bind(agent->sim, -1);
+    return NULL;
+}
+
+// Thread entry: runs the agent body, under the deterministic scheduler or
+// the virtual clock if one is active
+void* agent_thread(void* arg) {
+    AgentArg* agent = arg;
+    Simulation* sim = agent->sim;
+
+    if (sim->scheduler != NULL) {
+        sched_agent_start(sim, agent->slot);
+    }
+
+    agent_body(agent);
+
+    double cpu = thread_cpu_seconds();
+    LOCK_MUTEX(sim, &sim->school_mutex, "Agent: school mutex lock for CPU time");
+    record_thread_cpu(sim, cpu);
+    UNLOCK_MUTEX(sim, &sim->school_mutex, "Agent: school mutex unlock after CPU time");
+
+    if (sim->scheduler != NULL) {
+        sched_agent_exit(sim);
+    } else if (sim->virtual_clock != NULL) {
+        clock_agent_exit(sim);
+    }
+    return NULL;
+}
+
+// Run the agents on a pthread each and wait for all of them; matcher_arg may be NULL
+static void run_agent_threads(Simulation* sim, AgentArg* teacher_args, AgentArg* student_args,
+                              AgentArg* matcher_arg) {
+    // Create teacher threads
+    pthread_t* teacher_threads = checked_calloc((size_t)sim->config.num_teachers, sizeof(pthread_t),
+                                                "teacher threads");
+    for (int i = 0; i < sim->config.num_teachers; i++) {
+        CHECK_PTHREAD_RETURN(pthread_create(&teacher_threads[i], NULL, agent_thread, &teacher_args[i]),
+                            "Teacher thread creation");
+    }
+
+    // Create student threads
+    pthread_t* student_threads = checked_calloc((size_t)sim->config.total_students, sizeof(pthread_t),
+                                                "student threads");
+    for (int i = 0; i < sim->config.total_students; i++) {
+        CHECK_PTHREAD_RETURN(pthread_create(&student_threads[i], NULL, agent_thread, &student_args[i]),
+                            "Student thread creation");
+    }
+
+    pthread_t matcher_thread;
+    if (matcher_arg != NULL) {
+        CHECK_PTHREAD_RETURN(pthread_create(&matcher_thread, NULL, agent_thread, matcher_arg),
+                            "Matcher thread creation");
+    }
+
+    // Under the deterministic scheduler nothing runs until the first agent is picked
+    if (sim->scheduler != NULL) {
+        sched_run(sim);
+    }
+
+    // Wait for all threads to finish
+    for (int i = 0; i < sim->config.num_teachers; i++) {
+        CHECK_PTHREAD_RETURN(pthread_join(teacher_threads[i], NULL),
+                            "Teacher thread join");
+    }
+
+    for (int i = 0; i < sim->config.total_students; i++) {
+        CHECK_PTHREAD_RETURN(pthread_join(student_threads[i], NULL),
+                            "Student thread join");
+    }
+
+    if (matcher_arg != NULL) {
+        CHECK_PTHREAD_RETURN(pthread_join(matcher_thread, NULL),
+                            "Matcher thread join");
+    }
+
+    free(teacher_threads);
+    free(student_threads);
+}
+
+// Run one simulation as coroutines on the worker pool. Workers are shared
+// with other runs, so per-agent CPU time is not recorded.
+static void run_coroutines(Simulation* sim, AgentArg* teacher_args, AgentArg* student_args,
+                           AgentArg* matcher_arg) {
+    CoroRun* run = coro_run_begin(sim->config.workers, sim->config.time_scale == 0);
+    clock_start(sim, 0);
+    for (int i = 0; i < sim->config.num_teachers; i++) {
+        coro_spawn(run, agent_body, &teacher_args[i]);
+    }
+    for (int i = 0; i < sim->config.total_students; i++) {
+        coro_spawn(run, agent_body, &student_args[i]);
+    }
+    if (matcher_arg != NULL) {
+        coro_spawn(run, agent_body, matcher_arg);
+    }
+    coro_run_end(run);
+}
+
+// Run one simulation with a pthread (or coroutine) per teacher and per student,
+// plus the matcher agent if enabled
+void run_threads_engine(Simulation* sim) {
+    // Initialize resources
+    initialize_classrooms(sim);
+    int agent_count = sim->config.num_teachers + sim->config.total_students;
+    int total_agents = agent_count + (sim->config.matcher ? 1 : 0);
+    if (sim->config.engine == ENGINE_DETERMINISTIC) {
+        sched_init(sim, total_agents);
+    }
+
+    // One argument block per agent, alive until every thread has been joined
+    AgentArg* teacher_args = checked_calloc((size_t)sim->config.num_teachers, sizeof(AgentArg),
+                                            "teacher arguments");
+    AgentArg* student_args = checked_calloc((size_t)sim->config.total_students, sizeof(AgentArg),
+                                            "student arguments");
+
+    for (int i = 0; i < sim->config.num_teachers; i++) {
+        teacher_args[i].sim = sim;
+        teacher_args[i].id = i;
+        teacher_args[i].slot = i;
+        teacher_args[i].function = teacher_function;
+    }
+    for (int i = 0; i < sim->config.total_students; i++) {
+        student_args[i].sim = sim;
+        student_args[i].id = i;
+        student_args[i].slot = sim->config.num_teachers + i;
+        student_args[i].function = student_function;
+    }
+    AgentArg matcher_arg = { sim, 0, agent_count, matcher_function };
+
+    AgentArg* matcher = sim->config.matcher ? &matcher_arg : NULL;
+    if (sim->config.engine == ENGINE_COROUTINES) {
+        run_coroutines(sim, teacher_args, student_args, matcher);
+    } else {
+        clock_start(sim, total_agents);
+        run_agent_threads(sim, teacher_args, student_args, matcher);
+    }
+    clock_stop(sim);
+
+    free(teacher_args);
+    free(student_args);
+
+    // Clean up
+    if (sim->scheduler != NULL) {
+        sched_destroy(sim);
+    }
+    cleanup_resources(sim);
+}
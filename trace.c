@@ -0,0 +1,142 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zso.h"
+
+// Timeline tracing of the thread engines (--trace=FILE).
+//
+// Agents append a span to their own buffer whenever they leave a phase,
+// so recording takes no locks. At the end of the run the buffers are
+// written as one Chrome Trace Event file, with one track per agent and
+// the run as the process, which loads directly into Perfetto or
+// chrome://tracing. Timestamps are simulated time.
+
+typedef struct {
+    uint64_t begin_ns;
+    uint64_t end_ns;
+    int kind;
+    int classroom_id;
+} TraceSpan;
+
+struct TraceBuffer {
+    TraceSpan* spans;
+    size_t count;
+    size_t capacity;
+};
+
+static const char* const span_names[TRACE_SPAN_KINDS] = {
+    "Waiting for students",
+    "Teaching",
+    "Resetting classroom",
+    "Searching for a classroom",
+    "Waiting in classroom",
+    "In lesson",
+};
+
+static int agent_count(const Simulation* sim) {
+    return sim->config.num_teachers + sim->config.total_students;
+}
+
+void trace_init(Simulation* sim) {
+    sim->trace_buffers = checked_calloc((size_t)agent_count(sim), sizeof(TraceBuffer), "trace buffers");
+}
+
+void trace_free(Simulation* sim) {
+    if (sim->trace_buffers == NULL) {
+        return;
+    }
+    for (int i = 0; i < agent_count(sim); i++) {
+        free(sim->trace_buffers[i].spans);
+    }
+    free(sim->trace_buffers);
+}
+
+// Drop the previous run's spans, keeping the buffers
+void trace_reset(Simulation* sim) {
+    for (int i = 0; i < agent_count(sim); i++) {
+        sim->trace_buffers[i].count = 0;
+    }
+}
+
+// Record that an agent (teachers first, then students) spent
+// [begin_ns, end_ns) in a phase. Called only by that agent.
+void trace_span(Simulation* sim, int agent, int kind, int classroom_id, uint64_t begin_ns, uint64_t end_ns) {
+    if (sim->trace_buffers == NULL) {
+        return;
+    }
+
+    TraceBuffer* buffer = &sim->trace_buffers[agent];
+    if (buffer->count == buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity * 2 : 16;
+        TraceSpan* spans = realloc(buffer->spans, capacity * sizeof(TraceSpan));
+        if (spans == NULL) {
+            fprintf(stderr, "Failed to allocate memory for trace spans\n");
+            exit(EXIT_FAILURE);
+        }
+        buffer->spans = spans;
+        buffer->capacity = capacity;
+    }
+    buffer->spans[buffer->count++] = (TraceSpan){ begin_ns, end_ns, kind, classroom_id };
+}
+
+// Trace file of a run: the configured path, or with several runs the path
+// with the run number before its extension (trace.json -> trace-2.json)
+static void trace_file_name(const Simulation* sim, char* name, size_t size) {
+    const char* path = sim->config.trace_path;
+    if (sim->config.num_runs == 1) {
+        snprintf(name, size, "%s", path);
+        return;
+    }
+
+    const char* dot = strrchr(path, '.');
+    const char* slash = strrchr(path, '/');
+    if (dot == NULL || (slash != NULL && dot < slash)) {
+        dot = path + strlen(path);
+    }
+    snprintf(name, size, "%.*s-%d%s", (int)(dot - path), path, sim->run_id + 1, dot);
+}
+
+// Write the finished run as a Chrome Trace Event file
+void trace_write(Simulation* sim) {
+    char name[4096];
+    trace_file_name(sim, name, sizeof(name));
+
+    FILE* out = fopen(name, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Cannot open trace file '%s': %s\n", name, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    int pid = sim->run_id + 1;
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(out, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"Run %d\"}}",
+            pid, pid);
+
+    for (int agent = 0; agent < agent_count(sim); agent++) {
+        bool teacher = agent < sim->config.num_teachers;
+        int id = teacher ? agent : agent - sim->config.num_teachers;
+        fprintf(out, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, "
+                "\"args\": {\"name\": \"%s %d\"}}",
+                pid, agent, teacher ? "Teacher" : "Student", id);
+
+        const TraceBuffer* buffer = &sim->trace_buffers[agent];
+        for (size_t i = 0; i < buffer->count; i++) {
+            const TraceSpan* span = &buffer->spans[i];
+            // Trace Event timestamps are microseconds
+            fprintf(out, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, "
+                    "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"classroom\": %d}}",
+                    span_names[span->kind], teacher ? "teacher" : "student", pid, agent,
+                    (double)span->begin_ns / 1e3, (double)(span->end_ns - span->begin_ns) / 1e3,
+                    span->classroom_id);
+        }
+    }
+    fprintf(out, "\n]}\n");
+
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Failed to write trace file '%s': %s\n", name, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
@@ -0,0 +1,149 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zso.h"
+
+// Wakeup accounting per signal site (--wake-stats=on).
+//
+// Every SIGNAL_COND call site counts the signals it sends. Each condition
+// variable counts its waiters that no signal has reached yet; a signal hands
+// one of them (a broadcast all of them) a wakeup from its site, and a waiter
+// returning from wait_until takes up one such wakeup. The waiter charges it
+// to the site once it knows whether it got what it waited for: a quorum, a
+// lesson starting or ending, or for an idle student a seat or leaving school.
+// Sites that wake many agents which then find nothing to do are the
+// candidates for targeted signals. Which of several waiters a wake-one
+// signal reached is not known, so pending wakeups are taken up in any order.
+
+// Call site names; ids index Simulation.wake_sites
+static const char* site_names[MAX_WAKE_SITES];
+static SiteRegistry site_registry = SITE_REGISTRY_INITIALIZER(site_names, MAX_WAKE_SITES);
+
+static int wake_site_id(WakeSite* site) {
+    return site_registry_id(&site_registry, &site->id, site->name);
+}
+
+// Signal bookkeeping of a simulation condition variable: the matcher's, a
+// classroom's or a waiting student's
+static WakeTag* wake_tag_for(Simulation* sim, pthread_cond_t* cond) {
+    if (cond == &sim->matcher_cv) {
+        return &sim->matcher_wake;
+    }
+
+    char* address = (char*)cond;
+    char* classrooms = (char*)sim->classrooms;
+    if (address >= classrooms && address < classrooms + (size_t)sim->config.num_classes * sizeof(Classroom)) {
+        Classroom* room = &sim->classrooms[(size_t)(address - classrooms) / sizeof(Classroom)];
+        return cond == &room->lesson_start_cv ? &room->start_wake : &room->end_wake;
+    }
+
+    StudentWaiter* waiter = (StudentWaiter*)(address - offsetof(StudentWaiter, wakeup_cv));
+    return &waiter->wake;
+}
+
+// An agent is about to wait on cond. Caller holds the waiters' mutex.
+void wake_stats_wait_begin(Simulation* sim, pthread_cond_t* cond) {
+    if (sim->wake_sites != NULL) {
+        wake_tag_for(sim, cond)->waiting++;
+    }
+}
+
+// Record a signal on cond from site and how many waiters it reaches: one, all
+// of them with broadcast, or none if every waiter was already signalled.
+// Caller holds the waiters' mutex.
+void wake_stats_signal(Simulation* sim, pthread_cond_t* cond, bool broadcast, WakeSite* site) {
+    int id = wake_site_id(site);
+    atomic_fetch_add_explicit(&sim->wake_sites[id].signals, 1, memory_order_relaxed);
+
+    WakeTag* tag = wake_tag_for(sim, cond);
+    if (tag->waiting == 0) {
+        return;
+    }
+    if (broadcast) {
+        tag->pending_broadcast += tag->waiting;
+        tag->broadcast_site = id;
+        tag->waiting = 0;
+    } else {
+        tag->pending_signals++;
+        tag->signal_site = id;
+        tag->waiting--;
+    }
+}
+
+// Counters of the site whose signal ended a wait on cond, or NULL if the
+// wait timed out, woke without a signal or --wake-stats is off. Caller holds
+// the waiters' mutex again.
+WakeCounters* wake_stats_waker(Simulation* sim, pthread_cond_t* cond, int wait_result) {
+    if (sim->wake_sites == NULL) {
+        return NULL;
+    }
+
+    // Take up one signal sent to a waiter; a waiter that timed out just
+    // after being signalled uses up its signal without being woken by it
+    WakeTag* tag = wake_tag_for(sim, cond);
+    int site = -1;
+    if (wait_result == ETIMEDOUT && tag->waiting > 0) {
+        tag->waiting--;
+    } else if (tag->pending_signals > 0) {
+        tag->pending_signals--;
+        site = tag->signal_site;
+    } else if (tag->pending_broadcast > 0) {
+        tag->pending_broadcast--;
+        site = tag->broadcast_site;
+    } else if (tag->waiting > 0) {
+        tag->waiting--;  // Woken without a signal
+    }
+    return wait_result == ETIMEDOUT || site < 0 ? NULL : &sim->wake_sites[site];
+}
+
+void wake_stats_reset(Simulation* sim) {
+    if (sim->wake_sites != NULL) {
+        memset(sim->wake_sites, 0, MAX_WAKE_SITES * sizeof(WakeCounters));
+    }
+}
+
+typedef struct {
+    int id;
+    unsigned long long futile;
+} SiteFutility;
+
+static int compare_site_futile_desc(const void* a, const void* b) {
+    unsigned long long x = ((const SiteFutility*)a)->futile;
+    unsigned long long y = ((const SiteFutility*)b)->futile;
+    return (x < y) - (x > y);
+}
+
+// Signal sites ranked by the wakeups that led nowhere
+void print_wake_report(Simulation* sim, FILE* out) {
+    if (sim->wake_sites == NULL) {
+        return;
+    }
+
+    int site_count = site_registry_count(&site_registry);
+
+    SiteFutility order[MAX_WAKE_SITES];
+    int used = 0;
+    for (int i = 0; i < site_count; i++) {
+        const WakeCounters* counters = &sim->wake_sites[i];
+        if (atomic_load(&counters->signals) > 0) {
+            order[used].id = i;
+            order[used].futile = atomic_load(&counters->woken) - atomic_load(&counters->progress);
+            used++;
+        }
+    }
+    qsort(order, (size_t)used, sizeof(SiteFutility), compare_site_futile_desc);
+
+    fprintf(out, "\nWakeups by signal site, most futile first:\n");
+    fprintf(out, "  %-56s %10s %10s %10s %10s\n", "Signal site", "Signals", "Woken", "Progress", "Futile");
+    for (int i = 0; i < used; i++) {
+        const WakeCounters* counters = &sim->wake_sites[order[i].id];
+        fprintf(out, "  %-56s %10llu %10llu %10llu %10llu\n", site_names[order[i].id],
+                atomic_load(&counters->signals), atomic_load(&counters->woken),
+                atomic_load(&counters->progress), order[i].futile);
+    }
+}
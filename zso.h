@@ -0,0 +1,577 @@
+#ifndef ZSO_H
+#define ZSO_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Error checking macro for pthread functions
+#define CHECK_PTHREAD_RETURN(x, msg) \
+    do { \
+        int ret = (x); \
+        if (ret != 0) { \
+            fprintf(stderr, "%s failed: %s\n", msg, strerror(ret)); \
+            exit(EXIT_FAILURE); \
+        } \
+    } while(0)
+
+// Default simulation parameters (overridable at runtime, see parse_command_line)
+#define DEFAULT_NUM_CLASSES 5
+#define DEFAULT_STUDENTS_PER_CLASS 20
+#define DEFAULT_MIN_STUDENTS_FOR_LESSON 10
+#define DEFAULT_REQUIRED_LESSONS 3
+#define DEFAULT_WAIT_TIMEOUT_SEC 0.1 // Timeout for condition variable waits
+#define DEFAULT_NUM_RUNS 10
+#define DEFAULT_PARALLEL_RUNS 1
+#define DEFAULT_CONFIDENCE 0.95
+#define DEFAULT_LESSON_DURATION_SEC 0.0 // Simulated length of a lesson
+#define DEFAULT_TIME_SCALE 1.0 // Real seconds per simulated second; 0 = as fast as possible
+
+// Logging levels
+#define LOG_OFF     (-1)
+#define LOG_INFO    0
+#define LOG_DEBUG   1
+#define LOG_VERBOSE 2
+
+// Compilation flags
+// Uncomment to log at LOG_INFO by default (see --log-level)
+// #define DEBUG_PRINT
+
+#ifdef DEBUG_PRINT
+#define DEFAULT_LOG_LEVEL LOG_INFO
+#else
+#define DEFAULT_LOG_LEVEL LOG_OFF
+#endif
+
+// Static tracepoints of the agent lifecycle for bpftrace and perf, provider
+// "zso" (e.g. usdt:./ZSO_1:zso:lesson_start). With systemtap's <sys/sdt.h>
+// each probe is a nop plus an ELF note until a tracer attaches; without it,
+// or with NO_USDT defined, probes compile to nothing. Every probe carries
+// the teacher, student and classroom id, -1 where one does not apply.
+#if !defined(NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define HAVE_USDT
+#endif
+#endif
+
+#ifdef HAVE_USDT
+#define ZSO_PROBE(name, teacher_id, student_id, classroom_id) \
+    DTRACE_PROBE3(zso, name, teacher_id, student_id, classroom_id)
+#else
+#define ZSO_PROBE(name, teacher_id, student_id, classroom_id) do { } while(0)
+#endif
+
+// Classroom/Lesson states
+#define LESSON_WAITING 0
+#define LESSON_IN_PROGRESS 1
+#define LESSON_ENDED 2
+
+// Wait policies for idle students
+#define WAIT_POLICY_FIXED 0   // Always wait wait_timeout_sec
+#define WAIT_POLICY_BACKOFF 1 // Double the timeout after each fruitless wait
+#define WAIT_BACKOFF_MAX_FACTOR 16
+
+#define NSEC_PER_SEC 1000000000LL
+
+// Per-run output
+#define REPORT_RUNS 0    // Statistics of every run, then the batch summary
+#define REPORT_SUMMARY 1 // Only the batch summary
+
+#define BATCH_MIN_RUNS 5 // Runs before a batch may stop early
+
+// Simulation engines
+#define ENGINE_THREADS 0 // One pthread per teacher and student
+#define ENGINE_DES 1     // Single-threaded discrete-event simulation
+#define ENGINE_DETERMINISTIC 2 // Thread per agent, interleaved by a seeded scheduler
+#define ENGINE_COROUTINES 3 // Agents as coroutines on a shared pool of worker threads
+
+#define DEFAULT_SEED 1
+#define DEFAULT_MATCH_INTERVAL_SEC 0.001
+
+// Runtime simulation parameters
+typedef struct {
+    int num_classes;
+    int students_per_class;
+    int total_students;          // Derived: num_classes * students_per_class
+    int num_teachers;            // Derived: one teacher per classroom
+    int min_students_for_lesson;
+    int required_lessons;
+    double wait_timeout_sec;
+    int wait_policy;
+    double lesson_duration_sec;  // Simulated seconds a lesson lasts
+    double time_scale;           // Thread engines: real seconds per simulated second, 0 = virtual time
+    int num_runs;
+    int parallel_runs;           // Independent runs executed concurrently
+    int report;
+    double confidence;           // Confidence level of the batch intervals
+    double ci_half_width;        // Stop once the completion-rate intervals are this narrow; 0 = never
+    int engine;
+    int seed;                    // Scheduler seed for ENGINE_DETERMINISTIC
+    int workers;                 // Worker threads of ENGINE_COROUTINES; 0 = online CPUs
+    bool matcher;                // Thread engines: a matcher agent assigns waiting students
+    double match_interval_sec;   // Seconds between matching rounds; 0 = match on every change
+    bool lock_stats;             // Record mutex contention per mutex and call site
+    bool wake_stats;             // Thread engines: record wakeups and their outcome per signal site
+    const char* trace_path;      // Thread engines: Chrome trace output, NULL = off
+    const char* event_log_path;  // Binary event log of all runs, NULL = off
+    int log_level;               // Messages above this level are discarded
+} SimConfig;
+
+// Assumed cache line size for padding and alignment of shared data
+#define CACHE_LINE_SIZE 64
+
+// Names of the call sites of an instrumented macro (LOCK_MUTEX, SIGNAL_COND),
+// shared by all simulations. A site's id is assigned on first use and
+// indexes the per-simulation counters.
+typedef struct {
+    pthread_mutex_t mutex;
+    const char** names;         // capacity entries
+    int capacity;
+    const char* capacity_name;  // Constant to raise when the registry is full
+    int count;
+} SiteRegistry;
+
+#define SITE_REGISTRY_INITIALIZER(names_, capacity_) \
+    { .mutex = PTHREAD_MUTEX_INITIALIZER, .names = (names_), .capacity = (capacity_), .capacity_name = #capacity_ }
+
+// Lock contention counters, see lockstat.c
+#define MAX_LOCK_SITES 64
+
+typedef struct {
+    _Atomic unsigned long long acquisitions;
+    _Atomic unsigned long long trylock_failures;  // Acquisitions that had to block
+    _Atomic unsigned long long wait_ns;
+    _Atomic unsigned long long hold_ns;
+} LockCounters;
+
+// Counters of one mutex plus its current holder, written only by that holder
+typedef struct {
+    LockCounters counters;
+    unsigned long long locked_at_ns;
+    int locked_site;
+} MutexStats;
+
+// A LOCK_MUTEX call site; the id is assigned on first use
+typedef struct {
+    const char* name;
+    _Atomic int id;
+} LockSite;
+
+// Lock or unlock a simulation mutex, recording contention when --lock-stats is on.
+// msg names the call site, as for CHECK_PTHREAD_RETURN.
+#define LOCK_MUTEX(sim, mutex, msg) \
+    do { \
+        static LockSite lock_site_ = { msg, -1 }; \
+        lock_mutex((sim), (mutex), &lock_site_); \
+    } while(0)
+
+#define UNLOCK_MUTEX(sim, mutex, msg) unlock_mutex((sim), (mutex), (msg))
+
+// Wakeup counters of one signal site, see wakestats.c
+#define MAX_WAKE_SITES 32
+
+typedef struct {
+    _Atomic unsigned long long signals;   // Signals and broadcasts sent
+    _Atomic unsigned long long woken;     // Waits this site ended
+    _Atomic unsigned long long progress;  // ... after which the waiter got what it waited for
+} WakeCounters;
+
+// A SIGNAL_COND call site; the id is assigned on first use
+typedef struct {
+    const char* name;
+    _Atomic int id;
+} WakeSite;
+
+// Signals sent on one condition variable that the agents they woke have not
+// taken up yet; kept with --wake-stats under the mutex the waiters use
+typedef struct {
+    int waiting;            // Waiters no signal was sent to yet
+    int pending_signals;    // Waiters woken by a wake-one signal, not returned yet
+    int signal_site;        // ... and the site of the latest such signal
+    int pending_broadcast;  // Waiters woken by a broadcast, not returned yet
+    int broadcast_site;
+} WakeTag;
+
+// Wake one (or, with broadcast, every) agent waiting on cond, recording the
+// call site when --wake-stats is on. Caller holds the mutex the waiters use.
+#define SIGNAL_COND(sim, cond, broadcast, msg) \
+    do { \
+        static WakeSite wake_site_ = { msg, -1 }; \
+        signal_cond((sim), (cond), (broadcast), &wake_site_); \
+    } while(0)
+
+// Structure for classroom data. Classrooms are cache-line aligned so agents
+// busy with neighbouring rooms never share a line, and within a room the
+// fields every probing student reads, the mutex, each condition variable and
+// the cold membership data sit on separate lines.
+typedef struct {
+    // Hot lesson state
+    int id;
+    int state;
+    int teacher_id;
+    int students_count;       // Thread engines: set when the lesson starts, see admission
+    unsigned int generation;  // Bumped on every reset, invalidating all seats at once
+    _Atomic uint64_t admission;  // Thread engines: open flag, generation and seats claimed
+
+    _Alignas(CACHE_LINE_SIZE) pthread_mutex_t mutex;
+    _Alignas(CACHE_LINE_SIZE) pthread_cond_t lesson_start_cv;
+    _Alignas(CACHE_LINE_SIZE) pthread_cond_t lesson_end_cv;
+
+    // Cold: touched only when joining, resetting and with --lock-stats or --wake-stats
+    _Alignas(CACHE_LINE_SIZE) int* roster;  // Ids of the students inside, students_count entries
+    int roster_capacity;
+    MutexStats lock_stats;
+    WakeTag start_wake;     // Signals of lesson_start_cv
+    WakeTag end_wake;       // ... and lesson_end_cv
+} Classroom;
+
+// Thread engines admit students without the classroom mutex: the teacher
+// opens and closes a room by swapping its admission word and students claim
+// seats by compare-and-swap on it. Carrying the generation makes a claim on
+// a room that has since been reopened fail instead of joining the wrong lesson.
+#define ADMISSION_OPEN (1ULL << 63)
+#define ADMISSION_GENERATION_SHIFT 32
+#define ADMISSION_GENERATION_MASK 0x7FFFFFFFU
+#define ADMISSION_COUNT_MASK 0xFFFFFFFFULL
+
+// Where a student currently sits; only valid while generation matches the classroom's
+typedef struct {
+    int classroom_id;
+    unsigned int generation;
+} StudentSeat;
+
+// Students that found no classroom sleep on their own condition variable in
+// a FIFO protected by school_mutex, so a teacher opening a classroom wakes
+// only students eligible for it instead of broadcasting to the whole school
+typedef struct {
+    pthread_cond_t wakeup_cv;
+    int next;
+    int prev;
+    bool waiting;
+    int assigned_classroom;  // Seat claimed for the student by the matcher, or -1
+    WakeTag wake;            // Signals of wakeup_cv
+} StudentWaiter;
+
+// Latency metrics of the thread engines, in simulated time (latency.c)
+#define LATENCY_SEARCH_TO_JOIN 0  // Student: started looking for a classroom until seated
+#define LATENCY_JOIN_TO_START 1   // Student: seated until it saw the lesson in progress
+#define LATENCY_TEACHER_WAIT 2    // Teacher: time in the wait loop for the quorum
+#define LATENCY_TURNAROUND 3      // Student: started looking until the lesson ended
+#define LATENCY_METRICS 4
+
+typedef struct {
+    long long count;
+    double p50_sec;
+    double p99_sec;
+    double max_sec;
+} LatencySummary;
+
+typedef struct LatencyHistogram LatencyHistogram;
+
+// Agent phases in the timeline trace (trace.c)
+#define TRACE_TEACHER_WAITING 0   // Room open, waiting for the quorum
+#define TRACE_TEACHING 1
+#define TRACE_RESETTING 2         // Recording the lesson and resetting the room
+#define TRACE_STUDENT_SEARCHING 3 // Looking for a classroom, including idle waits
+#define TRACE_STUDENT_WAITING 4   // Seated, waiting for the lesson to start
+#define TRACE_IN_LESSON 5
+#define TRACE_SPAN_KINDS 6
+
+typedef struct TraceBuffer TraceBuffer;
+
+// Per-agent event counters of the thread engines (counters.c)
+#define COUNTER_PROBES 0            // Student: classrooms tried while searching
+#define COUNTER_FAILED_JOINS 1      // Student: tries that got no seat
+#define COUNTER_USEFUL_WAKEUPS 2    // Signalled waits that found their condition met
+#define COUNTER_SPURIOUS_WAKEUPS 3  // Signalled waits with nothing to do
+#define COUNTER_TIMEOUTS 4          // Timed waits that expired
+#define COUNTER_BROADCASTS 5        // Condition variable broadcasts sent
+#define COUNTER_LOCKS 6             // School and classroom mutex acquisitions
+#define COUNTER_KINDS 7
+
+typedef struct AgentCounters AgentCounters;
+
+// Binary event log (eventlog.c), read back by zso_replay
+#define EVENT_LOG_MAGIC "ZSOEVT1\n"
+#define EVENT_LOG_MAGIC_LENGTH 8
+#define EVENT_LOG_MAX_VARINT 10  // Bytes of a 64-bit LEB128 varint
+
+#define EVENT_LOG_RECORD_RUN_BEGIN 1
+#define EVENT_LOG_RECORD_CHUNK 2
+#define EVENT_LOG_RECORD_RUN_END 3
+
+// Event types; the comment names the argument
+#define EVENT_LOG_TEACHER_OPEN 0     // Classroom opened for a lesson
+#define EVENT_LOG_TEACHER_TIMEOUT 1  // Classroom
+#define EVENT_LOG_LESSON_START 2     // Students * 2, plus 1 if the teacher waited for the quorum
+#define EVENT_LOG_LESSON_END 3       // Classroom
+#define EVENT_LOG_TEACHER_LEAVE 4    // Lessons taught
+#define EVENT_LOG_STUDENT_SEARCH 5   // None: started looking for the next lesson
+#define EVENT_LOG_STUDENT_TIMEOUT 6  // None: idle wait for a classroom expired
+#define EVENT_LOG_STUDENT_JOIN 7     // Classroom
+#define EVENT_LOG_LESSON_SEEN 8      // Classroom whose lesson the student saw in progress
+#define EVENT_LOG_STUDENT_COMPLETE 9 // Classroom of the lesson attended
+#define EVENT_LOG_STUDENT_LEAVE 10   // Lessons attended
+#define EVENT_LOG_TYPES 11
+
+typedef struct EventBuffer EventBuffer;
+
+// Outcome of one run, filled in by project_zso
+typedef struct {
+    int students_completed;
+    int teachers_completed;
+    int* attendance_count;      // Students per number of lessons attended, required_lessons + 1 entries
+    int* classroom_attendance;  // Student-lessons per classroom
+    int lessons_taught;
+    double thread_cpu_sec;      // CPU time of all threads that ran agents
+    double thread_cpu_max_sec;  // ... and of the busiest one
+    double lesson_start_sec;    // Thread engines: total time from opening a room to starting its lesson
+    double lesson_start_max_sec;
+    double simulated_sec;       // Simulated time the run took
+    LatencySummary latency[LATENCY_METRICS];  // Thread engines only
+    unsigned long long counters[COUNTER_KINDS];  // Thread engines only, summed over all agents
+} RunResult;
+
+// Deterministic scheduler state (sched.c)
+typedef struct Scheduler Scheduler;
+
+// Virtual clock of a thread-per-agent run with --time-scale=0 (clock.c)
+typedef struct VirtualClock VirtualClock;
+
+// Everything a single run touches, so several contexts can be simulated at
+// the same time. Process-wide and shared by concurrent runs: the logger, the
+// coroutine worker pool and its virtual clock (coro.c), the LOCK_MUTEX and
+// SIGNAL_COND site registries, and the event log file (eventlog.c).
+typedef struct Simulation {
+    SimConfig config;
+    int run_id;
+
+    Classroom* classrooms;
+    int students_in_school;
+    int remaining_teachers;
+    pthread_mutex_t school_mutex;
+    MutexStats school_lock_stats;
+    LockCounters* lock_sites;  // MAX_LOCK_SITES entries when lock_stats is on
+    WakeCounters* wake_sites;  // MAX_WAKE_SITES entries when wake_stats is on
+
+    StudentWaiter* student_waiters;  // Thread-per-agent engines only
+    Scheduler* scheduler;            // Set while a deterministic run is active
+    VirtualClock* virtual_clock;     // Set while a virtual-time thread run is active
+    uint64_t clock_start_ns;         // Real (or pool) time the run started at
+    int waiters_head;
+    int waiters_tail;
+    pthread_cond_t matcher_cv;       // Wakes the matcher agent, under school_mutex
+    WakeTag matcher_wake;            // Signals of matcher_cv
+
+    // Student and teacher tracking
+    StudentSeat* student_seats;
+    int* student_lessons_attended;
+    int* teacher_lessons_taught;
+    int* student_lesson_history;  // total_students x required_lessons
+    int* teacher_lesson_history;  // num_teachers x required_lessons
+
+    // Students still in school, and how many of them have already visited each
+    // classroom; their difference is the number still eligible for it
+    int active_students;
+    int* classroom_visited_active;
+
+    // Per-student bitmap of visited classrooms (NULL if too large)
+    uint64_t* student_visited;
+    size_t visited_words;
+
+    // Per-agent latency samples, required_lessons slots per agent and metric;
+    // thread-per-agent engines only
+    uint64_t* latency_samples[LATENCY_METRICS];
+    LatencyHistogram* latency_histogram;  // Scratch space for merging the samples
+    TraceBuffer* trace_buffers;           // One per agent while tracing, teachers first
+    EventBuffer* event_buffers;           // One per agent with --event-log, teachers first
+    AgentCounters* agent_counters;        // Thread engines: one per agent and the matcher
+
+    // Classrooms with a teacher waiting for students, visited_words long;
+    // thread-per-agent engines only
+    _Atomic uint64_t* open_classrooms;
+
+    RunResult result;
+} Simulation;
+
+// Online mean and variance of one metric (Welford)
+typedef struct {
+    long long count;
+    double mean;
+    double m2;  // Sum of squared deviations from the mean
+    double min;
+    double max;
+} RunningStat;
+
+// Per-metric statistics over a batch of runs
+typedef struct {
+    int required_lessons;
+    int num_classes;
+    RunningStat student_completion;  // Percent of students per run
+    RunningStat teacher_completion;  // Percent of teachers per run
+    RunningStat* attendance;         // Students per number of lessons attended
+    RunningStat* utilization;        // Student-lessons per classroom
+} Batch;
+
+// Command line configuration (defined in options.c); also read by the logger
+extern SimConfig config;
+
+// Handles a program-specific option: returns false for unknown names, else
+// stores whether the value was valid in *ok
+typedef bool (*OptionHandler)(const char* name, const char* value, bool* ok);
+
+// Asynchronous logging (log.c); format strings must be literals
+void log_init(void);
+void log_message(int level, const char* format, ...);
+void log_flush(void);
+void log_shutdown(void);
+
+// Option parsing (options.c)
+bool parse_positive_int(const char* value, int* out);
+bool parse_non_negative_double(const char* value, double* out);
+bool parse_switch(const char* value, bool* out);
+bool apply_option(const char* name, const char* value);
+const char* copy_path(const char* value);
+bool load_config_file(const char* path);
+bool parse_command_line(int argc, char* argv[], void (*usage)(const char* program), OptionHandler extra);
+bool derive_config_sizes(SimConfig* sim_config);
+
+// Simulation contexts and shared helpers (school.c)
+void* checked_calloc(size_t count, size_t size, const char* what);
+void* checked_aligned_calloc(size_t count, size_t size, const char* what);
+int site_registry_id(SiteRegistry* registry, _Atomic int* site_id, const char* name);
+int site_registry_count(SiteRegistry* registry);
+uint64_t monotonic_ns(void);
+double thread_cpu_seconds(void);
+void record_thread_cpu(Simulation* sim, double seconds);
+Simulation* simulation_create(const SimConfig* config);
+void simulation_destroy(Simulation* sim);
+void project_zso(Simulation* sim);
+void collect_run_result(Simulation* sim);
+void generate_simulation_stats(Simulation* sim, FILE* out);
+int* student_history(Simulation* sim, int student_id);
+int* teacher_history(Simulation* sim, int teacher_id);
+bool student_already_attended_classroom(Simulation* sim, int student_id, int classroom_id, int lessons_attended);
+int record_student_lesson(Simulation* sim, int student_id, int classroom_id);
+void record_student_departure(Simulation* sim, int student_id);
+int eligible_students_for_classroom(Simulation* sim, int classroom_id);
+void classroom_open_admission(Classroom* room);
+int classroom_close_admission(Classroom* room);
+int classroom_seats_taken(const Classroom* room);
+int classroom_claim_seat(Simulation* sim, Classroom* room, int student_id);
+bool classroom_has_student(Simulation* sim, const Classroom* room, int student_id);
+void classroom_add_student(Simulation* sim, Classroom* room, int student_id);
+void classroom_reset_students(Classroom* room);
+
+// Latency histograms (latency.c)
+void latency_init(Simulation* sim);
+void latency_free(Simulation* sim);
+void latency_reset(Simulation* sim);
+void latency_record(Simulation* sim, int metric, int agent_id, int lesson, uint64_t latency_ns);
+void latency_collect(Simulation* sim);
+void print_latency_report(const Simulation* sim, FILE* out);
+
+// Timeline tracing (trace.c)
+void trace_init(Simulation* sim);
+void trace_free(Simulation* sim);
+void trace_reset(Simulation* sim);
+void trace_span(Simulation* sim, int agent, int kind, int classroom_id, uint64_t begin_ns, uint64_t end_ns);
+void trace_write(Simulation* sim);
+
+// Binary event log (eventlog.c)
+size_t varint_encode(uint64_t value, uint8_t* out);
+void event_log_open(void);
+void event_log_close(void);
+void event_log_init(Simulation* sim);
+void event_log_free(Simulation* sim);
+void event_log_begin_run(Simulation* sim);
+void event_log_end_run(Simulation* sim);
+void event_log_emit(Simulation* sim, int agent, int type, uint64_t now_ns, uint64_t argument);
+
+// Event counters (counters.c)
+void counters_init(Simulation* sim);
+void counters_free(Simulation* sim);
+void counters_reset(Simulation* sim);
+void counters_bind(Simulation* sim, int slot);
+AgentCounters* counters_current(void);
+void counters_restore(AgentCounters* counters);
+void counters_set_waker(WakeCounters* site);
+void counter_add(int counter);
+void counter_wait_result(int wait_result, bool progress);
+void counters_collect(Simulation* sim);
+void print_counter_report(const Simulation* sim, FILE* out);
+
+// Monte Carlo batches (batch.c)
+void running_stat_add(RunningStat* stat, double value);
+double running_stat_stddev(const RunningStat* stat);
+double running_stat_half_width(const RunningStat* stat, double confidence);
+void batch_init(Batch* batch, const SimConfig* config);
+void batch_free(Batch* batch);
+void batch_add_run(Batch* batch, const Simulation* sim);
+bool batch_converged(const Batch* batch, double confidence, double target_half_width);
+void batch_print(const Batch* batch, double confidence, FILE* out);
+
+// Wakeup accounting per signal site (wakestats.c)
+void wake_stats_wait_begin(Simulation* sim, pthread_cond_t* cond);
+void wake_stats_signal(Simulation* sim, pthread_cond_t* cond, bool broadcast, WakeSite* site);
+WakeCounters* wake_stats_waker(Simulation* sim, pthread_cond_t* cond, int wait_result);
+void wake_stats_reset(Simulation* sim);
+void print_wake_report(Simulation* sim, FILE* out);
+
+// Lock instrumentation (lockstat.c)
+void lock_mutex(Simulation* sim, pthread_mutex_t* mutex, LockSite* site);
+void unlock_mutex(Simulation* sim, pthread_mutex_t* mutex, const char* msg);
+void lock_wait_begin(Simulation* sim, pthread_mutex_t* mutex);
+void lock_wait_end(Simulation* sim, pthread_mutex_t* mutex);
+void lock_stats_reset(Simulation* sim);
+void print_lock_report(Simulation* sim, FILE* out);
+
+// Thread-per-agent engine (threads.c)
+void init_monotonic_cond(pthread_cond_t* cond, const char* msg);
+int wait_until(Simulation* sim, pthread_cond_t* cond, pthread_mutex_t* mutex, double timeout_sec, const char* msg);
+void signal_cond(Simulation* sim, pthread_cond_t* cond, bool broadcast, WakeSite* site);
+void remove_waiting_student(Simulation* sim, int student_id);
+void run_threads_engine(Simulation* sim);
+
+// Simulated time of the thread engines (clock.c)
+void clock_start(Simulation* sim, int agent_count);
+void clock_stop(Simulation* sim);
+uint64_t sim_now_ns(Simulation* sim);
+int clock_wait(Simulation* sim, pthread_cond_t* cond, pthread_mutex_t* mutex, double timeout_sec);
+void clock_signal(Simulation* sim, pthread_cond_t* cond, bool broadcast);
+void clock_agent_exit(Simulation* sim);
+
+// Centralized matching of waiting students to classrooms (matcher.c)
+void matcher_notify(Simulation* sim);
+void run_matcher(Simulation* sim);
+
+// Deterministic scheduling of the thread-per-agent engine (sched.c)
+void sched_init(Simulation* sim, int agent_count);
+void sched_destroy(Simulation* sim);
+void sched_run(Simulation* sim);
+void sched_agent_start(Simulation* sim, int agent);
+void sched_agent_exit(Simulation* sim);
+int sched_wait(Simulation* sim, pthread_cond_t* cond, pthread_mutex_t* mutex, double timeout_sec);
+void sched_signal(Simulation* sim, pthread_cond_t* cond, bool broadcast);
+double sched_now(Simulation* sim);
+
+// Coroutine worker pool shared by all runs (coro.c)
+typedef struct CoroRun CoroRun;
+CoroRun* coro_run_begin(int worker_count, bool virtual_time);
+void coro_spawn(CoroRun* run, void* (*function)(void*), void* arg);
+void coro_run_end(CoroRun* run);
+int coro_wait(pthread_cond_t* cond, pthread_mutex_t* mutex, double timeout_sec);
+void coro_signal(pthread_cond_t* cond, bool broadcast);
+void coro_pool_shutdown(void);
+uint64_t coro_now_ns(void);
+
+// Discrete-event engine (des.c)
+void run_des_engine(Simulation* sim);
+
+#endif // ZSO_H
@@ -0,0 +1,344 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "zso.h"
+
+// zso_replay: recomputes the statistics of every run in an event log
+// written with --event-log, without simulating anything. The file is mapped
+// and decoded in one pass; each run is rebuilt on a Simulation context of
+// its own, so the figures come from the same code as the live report
+// (collect_run_result, generate_simulation_stats, the latency histograms).
+// Runs are reported in the order they ended, followed by the batch summary
+// when the log holds more than one. See eventlog.c for the format.
+
+// Where an agent is in its current lesson
+typedef struct {
+    uint64_t opened_ns;   // Teacher: room opened
+    uint64_t started_ns;  // Teacher: lesson started
+    uint64_t search_ns;   // Student: started looking for a classroom
+    uint64_t joined_ns;   // Student: seated
+} AgentState;
+
+// A run whose RUN_END has not been read yet
+typedef struct ReplayRun {
+    Simulation* sim;
+    AgentState* agents;  // Teachers first, then students
+    long long teacher_timeouts;
+    long long student_timeouts;
+    struct ReplayRun* next;
+} ReplayRun;
+
+typedef struct {
+    const uint8_t* pos;
+    const uint8_t* end;
+} Reader;
+
+static void print_replay_usage(const char* program) {
+    printf("Usage: %s FILE\n"
+           "Recompute the statistics of every run recorded with --event-log=FILE.\n",
+           program);
+}
+
+static void corrupt(const char* what) {
+    fprintf(stderr, "Corrupt event log: %s\n", what);
+    exit(EXIT_FAILURE);
+}
+
+static uint64_t read_varint(Reader* reader) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 7 * EVENT_LOG_MAX_VARINT; shift += 7) {
+        if (reader->pos == reader->end) {
+            corrupt("truncated number");
+        }
+        uint8_t byte = *reader->pos++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    corrupt("number too long");
+    return 0;
+}
+
+// A varint that must fit the range of a simulation parameter or id
+static int read_int(Reader* reader, int limit, const char* what) {
+    uint64_t value = read_varint(reader);
+    if (value >= (uint64_t)limit) {
+        corrupt(what);
+    }
+    return (int)value;
+}
+
+// The open run with run_id, or NULL
+static ReplayRun* lookup_run(ReplayRun* runs, int run_id) {
+    for (ReplayRun* run = runs; run != NULL; run = run->next) {
+        if (run->sim->run_id == run_id) {
+            return run;
+        }
+    }
+    return NULL;
+}
+
+static ReplayRun* find_run(ReplayRun* runs, int run_id) {
+    ReplayRun* run = lookup_run(runs, run_id);
+    if (run == NULL) {
+        corrupt("record of a run that has not begun");
+    }
+    return run;
+}
+
+// RUN_BEGIN: a fresh context for the run, reset as project_zso would
+static ReplayRun* begin_run(Reader* reader, ReplayRun* runs) {
+    SimConfig run_config = config;
+    int run_id = read_int(reader, INT32_MAX, "run number");
+    if (lookup_run(runs, run_id) != NULL) {
+        corrupt("run begun twice");
+    }
+    run_config.num_classes = read_int(reader, INT32_MAX, "class count");
+    run_config.students_per_class = read_int(reader, INT32_MAX, "class size");
+    run_config.min_students_for_lesson = read_int(reader, INT32_MAX, "minimum students");
+    run_config.required_lessons = read_int(reader, INT32_MAX, "lesson count");
+    run_config.engine = read_int(reader, ENGINE_COROUTINES + 1, "engine");
+    if (run_config.num_classes == 0 || run_config.students_per_class == 0 || run_config.required_lessons == 0 ||
+        !derive_config_sizes(&run_config)) {
+        corrupt("run configuration");
+    }
+
+    ReplayRun* run = checked_calloc(1, sizeof(ReplayRun), "replayed run");
+    run->sim = simulation_create(&run_config);
+    run->agents = checked_calloc((size_t)run_config.num_teachers + (size_t)run_config.total_students,
+                                 sizeof(AgentState), "replayed agents");
+
+    Simulation* sim = run->sim;
+    sim->run_id = run_id;
+    sim->students_in_school = run_config.total_students;
+    sim->remaining_teachers = run_config.num_teachers;
+    sim->active_students = run_config.total_students;
+
+    // The event engine keeps no latency samples of its own, but its log has them
+    if (sim->latency_histogram == NULL) {
+        latency_init(sim);
+    }
+    latency_reset(sim);
+    return run;
+}
+
+static void replay_teacher_event(ReplayRun* run, int teacher_id, int type, uint64_t now_ns, uint64_t argument) {
+    Simulation* sim = run->sim;
+    AgentState* agent = &run->agents[teacher_id];
+    int lessons_taught = sim->teacher_lessons_taught[teacher_id];
+
+    switch (type) {
+        case EVENT_LOG_TEACHER_OPEN:
+            agent->opened_ns = now_ns;
+            break;
+        case EVENT_LOG_TEACHER_TIMEOUT:
+            run->teacher_timeouts++;
+            break;
+        case EVENT_LOG_LESSON_START:
+            if (lessons_taught == sim->config.required_lessons) {
+                corrupt("lesson start");
+            }
+            agent->started_ns = now_ns;
+            // Lessons that started without waiting for the quorum have no wait
+            if (argument & 1) {
+                latency_record(sim, LATENCY_TEACHER_WAIT, teacher_id, lessons_taught, now_ns - agent->opened_ns);
+            }
+            break;
+        case EVENT_LOG_LESSON_END: {
+            if (argument >= (uint64_t)sim->config.num_classes || lessons_taught == sim->config.required_lessons) {
+                corrupt("lesson end");
+            }
+            double time_to_start = (double)(agent->started_ns - agent->opened_ns) / NSEC_PER_SEC;
+            sim->result.lesson_start_sec += time_to_start;
+            if (time_to_start > sim->result.lesson_start_max_sec) {
+                sim->result.lesson_start_max_sec = time_to_start;
+            }
+            teacher_history(sim, teacher_id)[lessons_taught] = (int)argument;
+            sim->teacher_lessons_taught[teacher_id] = lessons_taught + 1;
+            break;
+        }
+        case EVENT_LOG_TEACHER_LEAVE:
+            sim->remaining_teachers--;
+            break;
+        default:
+            corrupt("student event of a teacher");
+    }
+}
+
+static void replay_student_event(ReplayRun* run, int student_id, int type, uint64_t now_ns, uint64_t argument) {
+    Simulation* sim = run->sim;
+    AgentState* agent = &run->agents[sim->config.num_teachers + student_id];
+    int lessons_attended = sim->student_lessons_attended[student_id];
+
+    switch (type) {
+        case EVENT_LOG_STUDENT_SEARCH:
+            agent->search_ns = now_ns;
+            break;
+        case EVENT_LOG_STUDENT_TIMEOUT:
+            run->student_timeouts++;
+            break;
+        case EVENT_LOG_STUDENT_JOIN:
+            if (lessons_attended == sim->config.required_lessons) {
+                corrupt("student join");
+            }
+            agent->joined_ns = now_ns;
+            latency_record(sim, LATENCY_SEARCH_TO_JOIN, student_id, lessons_attended, now_ns - agent->search_ns);
+            break;
+        case EVENT_LOG_LESSON_SEEN:
+            if (lessons_attended == sim->config.required_lessons) {
+                corrupt("lesson seen");
+            }
+            latency_record(sim, LATENCY_JOIN_TO_START, student_id, lessons_attended, now_ns - agent->joined_ns);
+            break;
+        case EVENT_LOG_STUDENT_COMPLETE:
+            if (argument >= (uint64_t)sim->config.num_classes || lessons_attended == sim->config.required_lessons) {
+                corrupt("lesson completion");
+            }
+            latency_record(sim, LATENCY_TURNAROUND, student_id, lessons_attended, now_ns - agent->search_ns);
+            record_student_lesson(sim, student_id, (int)argument);
+            break;
+        case EVENT_LOG_STUDENT_LEAVE:
+            sim->students_in_school--;
+            break;
+        default:
+            corrupt("teacher event of a student");
+    }
+}
+
+// CHUNK: decode one agent's events
+static void replay_chunk(Reader* reader, ReplayRun* runs) {
+    ReplayRun* run = find_run(runs, read_int(reader, INT32_MAX, "run number"));
+    Simulation* sim = run->sim;
+    int agent = read_int(reader, sim->config.num_teachers + sim->config.total_students, "agent");
+    uint64_t now_ns = read_varint(reader);
+    uint64_t length = read_varint(reader);
+    if (length > (uint64_t)(reader->end - reader->pos)) {
+        corrupt("truncated chunk");
+    }
+
+    Reader events = { reader->pos, reader->pos + length };
+    reader->pos += length;
+
+    while (events.pos < events.end) {
+        int type = *events.pos++;
+        if (type >= EVENT_LOG_TYPES) {
+            corrupt("event type");
+        }
+        now_ns += read_varint(&events);
+        uint64_t argument = read_varint(&events);
+
+        if (agent < sim->config.num_teachers) {
+            replay_teacher_event(run, agent, type, now_ns, argument);
+        } else {
+            replay_student_event(run, agent - sim->config.num_teachers, type, now_ns, argument);
+        }
+    }
+}
+
+// RUN_END: report the run and add it to the batch
+static void end_run(ReplayRun* run, uint64_t simulated_ns, Batch* batch, bool* batch_started) {
+    Simulation* sim = run->sim;
+    sim->result.simulated_sec = (double)simulated_ns / NSEC_PER_SEC;
+    collect_run_result(sim);
+    latency_collect(sim);
+
+    printf("\n===== Replayed simulation run %d =====\n", sim->run_id + 1);
+    generate_simulation_stats(sim, stdout);
+    if (sim->config.engine == ENGINE_DES) {
+        print_latency_report(sim, stdout);
+    }
+    printf("\nTimeouts: %lld teacher waits, %lld idle student waits\n",
+           run->teacher_timeouts, run->student_timeouts);
+
+    if (!*batch_started) {
+        batch_init(batch, &sim->config);
+        *batch_started = true;
+    }
+    batch_add_run(batch, sim);
+}
+
+static void free_run(ReplayRun* run) {
+    simulation_destroy(run->sim);
+    free(run->agents);
+    free(run);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2 || strcmp(argv[1], "--help") == 0) {
+        print_replay_usage(argv[0]);
+        return argc == 2 ? 0 : EXIT_FAILURE;
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Cannot open event log '%s': %s\n", argv[1], strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if ((size_t)st.st_size < EVENT_LOG_MAGIC_LENGTH) {
+        corrupt("no header");
+    }
+
+    const uint8_t* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Cannot map event log '%s': %s\n", argv[1], strerror(errno));
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    madvise((void*)data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    if (memcmp(data, EVENT_LOG_MAGIC, EVENT_LOG_MAGIC_LENGTH) != 0) {
+        corrupt("not an event log");
+    }
+
+    Reader reader = { data + EVENT_LOG_MAGIC_LENGTH, data + st.st_size };
+    ReplayRun* runs = NULL;
+    Batch batch;
+    bool batch_started = false;
+
+    while (reader.pos < reader.end) {
+        int record = *reader.pos++;
+        if (record == EVENT_LOG_RECORD_RUN_BEGIN) {
+            ReplayRun* run = begin_run(&reader, runs);
+            run->next = runs;
+            runs = run;
+        } else if (record == EVENT_LOG_RECORD_CHUNK) {
+            replay_chunk(&reader, runs);
+        } else if (record == EVENT_LOG_RECORD_RUN_END) {
+            ReplayRun** link = &runs;
+            ReplayRun* run = find_run(runs, read_int(&reader, INT32_MAX, "run number"));
+            while (*link != run) {
+                link = &(*link)->next;
+            }
+            *link = run->next;
+            end_run(run, read_varint(&reader), &batch, &batch_started);
+            free_run(run);
+        } else {
+            corrupt("record type");
+        }
+    }
+
+    for (ReplayRun* run = runs; run != NULL; run = runs) {
+        fprintf(stderr, "Run %d has no end record; the log is incomplete\n", run->sim->run_id + 1);
+        runs = run->next;
+        free_run(run);
+    }
+
+    if (batch_started) {
+        if (batch.student_completion.count > 1) {
+            batch_print(&batch, config.confidence, stdout);
+        }
+        batch_free(&batch);
+    }
+
+    munmap((void*)data, (size_t)st.st_size);
+    return 0;
+}